@@ -0,0 +1,444 @@
+///////////////////////////////////////////////////////////////////////////////
+// batch.hh
+//
+// Answer a stream of ride queries against one catalog, for the maxtime
+// command-line tool.
+//
+// Each query names a filter window (min_time, max_time, total_size, as for
+// filter_ride_vector), a budget, and an engine. Queries are read in batches:
+// the distinct queries of a batch that are not already in the result cache
+// are solved on a pool of threads, each filter window is filtered once per
+// batch, and the answers are written in input order as one block of text.
+//
+// Text queries are one per line:
+//
+//    min_time max_time total_size budget engine
+//
+// where engine is one of dynamic, exhaustive, reduced, compressed or
+// branch_bound; exhaustive takes at most BATCH_EXHAUSTIVE_RIDES filtered
+// rides. Empty lines and lines starting with '#' are skipped. Binary
+// queries are BinaryQuery records, back to back, in host byte order.
+//
+// Each answer is one line: the query's number (from 1), the total cost, the
+// total time, and the catalog indices of the chosen rides in increasing order:
+//
+//    3 498 9564.92 17 245 1022 ...
+//
+// or the query's number followed by "error" and a reason.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <list>
+#include <map>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+
+#include "branch_bound.hh"
+#include "maxtime.hh"
+#include "parallel_report.hh"
+#include "reachable.hh"
+#include "reduction.hh"
+
+
+// Solvers a query can ask for.
+enum QueryEngine
+{
+	ENGINE_DYNAMIC,
+	ENGINE_EXHAUSTIVE,
+	ENGINE_REDUCED,
+	ENGINE_COMPRESSED,
+	ENGINE_BRANCH_BOUND,
+	ENGINE_COUNT
+};
+
+// Names of the engines in text queries, indexed by QueryEngine.
+const char* const QUERY_ENGINE_NAMES[ENGINE_COUNT] = { "dynamic", "exhaustive", "reduced", "compressed", "branch_bound" };
+
+// Most filtered rides an exhaustive query may search; 2^n subsets of many more would stall
+// every query after it in the stream.
+const size_t BATCH_EXHAUSTIVE_RIDES = 25;
+
+
+// One query: the best rides within budget among filter_ride_vector(catalog, min_time, max_time, total_size).
+struct RideQuery
+{
+	double min_time;
+	double max_time;
+	int total_size;
+	int budget;
+	QueryEngine engine;
+
+	bool operator<(const RideQuery& other) const
+	{
+		return std::tie(min_time, max_time, total_size, budget, engine)
+			< std::tie(other.min_time, other.max_time, other.total_size, other.budget, other.engine);
+	}
+};
+
+
+// Layout of a binary query record.
+struct BinaryQuery
+{
+	double min_time;
+	double max_time;
+	int32_t total_size;
+	int32_t budget;
+
+	// A QueryEngine value.
+	uint32_t engine;
+
+	// Padding to a multiple of 8 bytes; ignored.
+	uint32_t reserved;
+};
+
+
+// Check the fields of a query that its format cannot: the time window must be finite,
+// since a NaN would break the ordering of queries in a batch and the cache, and total_size
+// must not be negative. Returns false and sets error if not.
+inline bool check_query(const RideQuery& query, std::string& error)
+{
+	if (!std::isfinite(query.min_time) || !std::isfinite(query.max_time))
+	{
+		error = "time window is not finite";
+		return false;
+	}
+	if (query.total_size < 0)
+	{
+		error = "total_size is negative";
+		return false;
+	}
+	return true;
+}
+
+
+// Parse a text query; returns false and sets error if the line is malformed.
+inline bool parse_query(const std::string& line, RideQuery& query, std::string& error)
+{
+	std::istringstream fields(line);
+	std::string engine, extra;
+	if (!(fields >> query.min_time >> query.max_time >> query.total_size >> query.budget >> engine))
+	{
+		error = "want: min_time max_time total_size budget engine";
+		return false;
+	}
+	if (fields >> extra)
+	{
+		error = "unexpected field " + extra;
+		return false;
+	}
+	for (int e = 0; e < ENGINE_COUNT; e++)
+	{
+		if (engine == QUERY_ENGINE_NAMES[e])
+		{
+			query.engine = QueryEngine(e);
+			return check_query(query, error);
+		}
+	}
+	error = "unknown engine " + engine;
+	return false;
+}
+
+
+// Least recently used cache of answer text by query.
+class QueryCache
+{
+	//
+	public:
+
+		//
+		explicit QueryCache(size_t capacity) : _capacity(capacity), _hits(0) { }
+
+		// The cached answer to query, if any.
+		bool find(const RideQuery& query, std::string& answer)
+		{
+			auto found = _entries.find(query);
+			if (found == _entries.end())
+			{
+				return false;
+			}
+			_order.splice(_order.begin(), _order, found->second.second);
+			answer = found->second.first;
+			_hits++;
+			return true;
+		}
+
+		// Remember the answer to query, evicting the least recently used answer if full.
+		void insert(const RideQuery& query, const std::string& answer)
+		{
+			if (_capacity == 0 || _entries.count(query) != 0)
+			{
+				return;
+			}
+			if (_entries.size() == _capacity)
+			{
+				_entries.erase(_order.back());
+				_order.pop_back();
+			}
+			_order.push_front(query);
+			_entries[query] = std::make_pair(answer, _order.begin());
+		}
+
+		// Number of answers served from the cache.
+		size_t hits() const { return _hits; }
+
+	//
+	private:
+
+		size_t _capacity, _hits;
+		std::list<RideQuery> _order;
+		std::map<RideQuery, std::pair<std::string, std::list<RideQuery>::iterator>> _entries;
+};
+
+
+// Answers queries against a catalog; see the top of this file.
+class QueryBatchSolver
+{
+	//
+	public:
+
+		// Queries read and solved together.
+		static const size_t BATCH_SIZE = 256;
+
+		// threads solves a batch's queries in parallel; 0 means one per hardware thread.
+		// If report is not null, each batch's filter, solve and write phases are added to it.
+		QueryBatchSolver(const RideVector& catalog, size_t cache_capacity = 4096, size_t threads = 0, ParallelReport* report = nullptr)
+			:
+			_catalog(catalog),
+			_cache(cache_capacity),
+			_threads(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+			_report(report)
+		{
+			for (size_t i = 0; i < catalog.size(); i++)
+			{
+				_index[catalog[i].get()] = i;
+			}
+		}
+
+		// Answer text queries from in, one per line, until in ends.
+		void run_text(std::istream& in, std::ostream& out)
+		{
+			std::vector<Pending> batch;
+			size_t number = 0;
+			for (std::string line; std::getline(in, line); )
+			{
+				if (line.empty() || line[0] == '#')
+				{
+					continue;
+				}
+				Pending pending;
+				pending.number = ++number;
+				pending.valid = parse_query(line, pending.query, pending.answer);
+				batch.push_back(pending);
+				if (batch.size() == BATCH_SIZE)
+				{
+					solve_batch(batch, out);
+				}
+			}
+			solve_batch(batch, out);
+		}
+
+		// Answer BinaryQuery records from in until in ends.
+		void run_binary(std::istream& in, std::ostream& out)
+		{
+			std::vector<Pending> batch;
+			size_t number = 0;
+			BinaryQuery record;
+			while (in.read(reinterpret_cast<char*>(&record), sizeof(record)))
+			{
+				Pending pending;
+				pending.number = ++number;
+				pending.query = RideQuery{ record.min_time, record.max_time, record.total_size, record.budget, QueryEngine(record.engine) };
+				pending.valid = record.engine < ENGINE_COUNT && check_query(pending.query, pending.answer);
+				if (record.engine >= ENGINE_COUNT)
+				{
+					pending.answer = "unknown engine " + std::to_string(record.engine);
+				}
+				batch.push_back(pending);
+				if (batch.size() == BATCH_SIZE)
+				{
+					solve_batch(batch, out);
+				}
+			}
+			if (in.gcount() != 0)
+			{
+				Pending pending;
+				pending.number = ++number;
+				pending.valid = false;
+				pending.answer = "truncated record";
+				batch.push_back(pending);
+			}
+			solve_batch(batch, out);
+		}
+
+		// Number of answers served from the result cache.
+		size_t cache_hits() const { return _cache.hits(); }
+
+	//
+	private:
+
+		// A query read but not yet answered; answer holds the error if it is not valid.
+		struct Pending
+		{
+			size_t number;
+			RideQuery query;
+			bool valid;
+			std::string answer;
+		};
+
+		// Solve the batch, write its answers in order, and empty it.
+		void solve_batch(std::vector<Pending>& batch, std::ostream& out)
+		{
+			// distinct queries not in the cache, grouped by filter window so each window is filtered once
+			std::map<RideQuery, std::string> answers;
+			for (Pending& pending : batch)
+			{
+				if (pending.valid && !_cache.find(pending.query, pending.answer))
+				{
+					answers[pending.query];
+				}
+			}
+
+			std::map<std::tuple<double, double, int>, std::unique_ptr<RideVector>> windows;
+			{
+				ParallelPhase phase(_report, "batch filter", 1);
+				ThreadCpuTimer filter_cpu;
+				for (auto& entry : answers)
+				{
+					const RideQuery& query = entry.first;
+					auto& filtered = windows[std::make_tuple(query.min_time, query.max_time, query.total_size)];
+					if (!filtered)
+					{
+						filtered = filter_ride_vector(_catalog, query.min_time, query.max_time, query.total_size);
+					}
+				}
+				phase.record_thread(0, filter_cpu.elapsed());
+			}
+
+			std::vector<std::pair<const RideQuery*, std::string*>> work;
+			for (auto& entry : answers)
+			{
+				work.push_back(std::make_pair(&entry.first, &entry.second));
+			}
+			{
+				size_t threads = std::max<size_t>(1, std::min(_threads, work.size()));
+				ParallelPhase phase(_report, "batch solve", threads);
+				std::atomic<size_t> next(0);
+				auto worker = [&](size_t t)
+				{
+					ThreadCpuTimer cpu;
+					for (size_t k; (k = next.fetch_add(1)) < work.size(); )
+					{
+						const RideQuery& query = *work[k].first;
+						const RideVector& rides = *windows.at(std::make_tuple(query.min_time, query.max_time, query.total_size));
+						try
+						{
+							*work[k].second = solve(query, rides);
+						}
+						catch (const std::bad_alloc&)
+						{
+							*work[k].second = "error out of memory";
+						}
+					}
+					phase.record_thread(t, cpu.elapsed());
+				};
+				std::vector<std::thread> pool;
+				for (size_t t = 1; t < threads; t++)
+				{
+					pool.emplace_back(worker, t);
+				}
+				worker(0);
+				for (std::thread& thread : pool)
+				{
+					thread.join();
+				}
+			}
+
+			ParallelPhase phase(_report, "batch write", 1);
+			ThreadCpuTimer write_cpu;
+
+			for (auto& entry : answers)
+			{
+				_cache.insert(entry.first, entry.second);
+			}
+
+			// one write for the whole batch
+			std::string text;
+			for (Pending& pending : batch)
+			{
+				if (pending.valid && pending.answer.empty())
+				{
+					pending.answer = answers[pending.query];
+				}
+				text += std::to_string(pending.number);
+				text += pending.valid ? " " : " error ";
+				text += pending.answer;
+				text += '\n';
+			}
+			out << text;
+			batch.clear();
+			phase.record_thread(0, write_cpu.elapsed());
+		}
+
+		// Answer text for one query over its filtered rides.
+		std::string solve(const RideQuery& query, const RideVector& rides) const
+		{
+			std::unique_ptr<RideVector> best;
+			switch (query.engine)
+			{
+				case ENGINE_DYNAMIC: best = dynamic_max_time(rides, query.budget); break;
+				case ENGINE_REDUCED: best = reduced_dynamic_max_time(rides, query.budget); break;
+				case ENGINE_COMPRESSED: best = compressed_dynamic_max_time(rides, query.budget); break;
+				case ENGINE_BRANCH_BOUND: best = branch_bound_max_time(rides, query.budget, 1); break;
+				case ENGINE_EXHAUSTIVE:
+					if (rides.size() > BATCH_EXHAUSTIVE_RIDES)
+					{
+						return "error exhaustive search takes at most " + std::to_string(BATCH_EXHAUSTIVE_RIDES) + " rides";
+					}
+					best = exhaustive_max_time(rides, query.budget);
+					break;
+				default: return "error unknown engine";
+			}
+
+			int total_cost;
+			double total_time;
+			sum_ride_vector(*best, total_cost, total_time);
+			std::vector<size_t> indices;
+			for (auto& ride : *best)
+			{
+				indices.push_back(_index.at(ride.get()));
+			}
+			std::sort(indices.begin(), indices.end());
+
+			std::ostringstream answer;
+			answer << total_cost << ' ' << total_time;
+			for (size_t i : indices)
+			{
+				answer << ' ' << i;
+			}
+			return answer.str();
+		}
+
+		const RideVector& _catalog;
+		QueryCache _cache;
+		size_t _threads;
+		ParallelReport* _report;
+		std::unordered_map<const RideItem*, size_t> _index;
+};
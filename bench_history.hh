@@ -0,0 +1,431 @@
+///////////////////////////////////////////////////////////////////////////////
+// bench_history.hh
+//
+// An append-only store of benchmark results, and a statistical comparison of
+// two runs, for maxtime_bench --record and --compare.
+//
+// Each benchmark of a run is one JSON line holding the run's id (its start
+// in milliseconds since the epoch), the git
+// revision, a fingerprint of the host, the benchmark's name and every timing
+// sample in seconds:
+//
+//    {"run": "1760870400123", "revision": "e9a3ab0", "host": "...", "benchmark": "dynamic_max_time", "samples": [0.0021, ...]}
+//
+// Comparing two runs applies a one-sided Mann-Whitney U test to the samples of
+// each benchmark they share: a benchmark is flagged as slower when the
+// candidate's samples rank significantly above the baseline's and its median
+// is also slower by at least a minimum ratio, so that neither a lucky single
+// timing nor a significant but negligible shift raises an alarm.
+//
+// How to use:
+//
+//    append_benchmark_history("bench_history.jsonl", records);
+//    auto history = load_benchmark_history("bench_history.jsonl");
+//    for (auto& result : compare_benchmark_runs(history, base_run, new_run))
+//        if (result.slower) ...
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+#include <unistd.h>
+
+
+#include "isa.hh"
+
+
+// The timings of one benchmark in one run.
+struct BenchmarkRecord
+{
+	std::string run;
+	std::string revision;
+	std::string host;
+	std::string benchmark;
+	std::vector<double> samples;
+};
+
+
+// Hostname, CPU model, hardware threads and kernel target; runs with different
+// fingerprints were not timed on comparable machines.
+inline std::string host_fingerprint()
+{
+	char hostname[256] = "unknown";
+	gethostname(hostname, sizeof(hostname) - 1);
+
+	std::string model = "unknown";
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	for (std::string line; std::getline(cpuinfo, line); )
+	{
+		if (line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos)
+		{
+			model = line.substr(line.find(':') + 2);
+			break;
+		}
+	}
+
+	return std::string(hostname) + "/" + model + "/" + std::to_string(std::thread::hardware_concurrency())
+		+ " threads/" + kernel_target();
+}
+
+
+// The short git revision of the working directory, or "unknown" outside a checkout.
+// MAXTIME_REVISION overrides it, e.g. for builds from a tarball.
+inline std::string git_revision()
+{
+	if (const char* revision = std::getenv("MAXTIME_REVISION"))
+	{
+		return revision;
+	}
+
+	std::string revision;
+	if (FILE* git = popen("git rev-parse --short HEAD 2>/dev/null", "r"))
+	{
+		char buffer[128];
+		while (fgets(buffer, sizeof(buffer), git) != nullptr)
+		{
+			revision += buffer;
+		}
+		pclose(git);
+	}
+	while (!revision.empty() && std::isspace((unsigned char)revision.back()))
+	{
+		revision.pop_back();
+	}
+	return revision.empty() ? "unknown" : revision;
+}
+
+
+// text as a JSON string literal.
+inline std::string json_quote(const std::string& text)
+{
+	std::string quoted = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			quoted += '\\';
+			quoted += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			char escape[8];
+			std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+			quoted += escape;
+		}
+		else
+		{
+			quoted += c;
+		}
+	}
+	return quoted + "\"";
+}
+
+
+// One record as a line of JSON, without the newline.
+inline std::string format_benchmark_record(const BenchmarkRecord& record)
+{
+	std::ostringstream line;
+	line.precision(17);
+	line << "{\"run\": " << json_quote(record.run) << ", \"revision\": " << json_quote(record.revision)
+		<< ", \"host\": " << json_quote(record.host) << ", \"benchmark\": " << json_quote(record.benchmark)
+		<< ", \"samples\": [";
+	for (size_t s = 0; s < record.samples.size(); s++)
+	{
+		line << (s == 0 ? "" : ", ") << record.samples[s];
+	}
+	line << "]}";
+	return line.str();
+}
+
+
+// Parse a line written by format_benchmark_record; unknown keys are skipped.
+// Returns false if the line is not such a record.
+inline bool parse_benchmark_record(const std::string& line, BenchmarkRecord& record)
+{
+	size_t at = 0;
+	auto skip_space = [&]()
+	{
+		while (at < line.size() && std::isspace((unsigned char)line[at]))
+		{
+			at++;
+		}
+	};
+	auto expect = [&](char c)
+	{
+		skip_space();
+		if (at < line.size() && line[at] == c)
+		{
+			at++;
+			return true;
+		}
+		return false;
+	};
+	auto parse_string = [&](std::string& text)
+	{
+		if (!expect('"'))
+		{
+			return false;
+		}
+		text.clear();
+		for (; at < line.size() && line[at] != '"'; at++)
+		{
+			if (line[at] == '\\' && at + 1 < line.size())
+			{
+				at++;
+				if (line[at] == 'u' && at + 4 < line.size())
+				{
+					text += char(std::strtol(line.substr(at + 1, 4).c_str(), nullptr, 16));
+					at += 4;
+					continue;
+				}
+			}
+			text += line[at];
+		}
+		return expect('"');
+	};
+	auto parse_number = [&](double& value)
+	{
+		skip_space();
+		const char* begin = line.c_str() + at;
+		char* end;
+		value = std::strtod(begin, &end);
+		at += end - begin;
+		return end != begin;
+	};
+
+	record = BenchmarkRecord();
+	bool has_benchmark = false;
+	if (!expect('{'))
+	{
+		return false;
+	}
+	while (!expect('}'))
+	{
+		std::string key;
+		if (!parse_string(key) || !expect(':'))
+		{
+			return false;
+		}
+
+		skip_space();
+		if (key == "samples")
+		{
+			if (!expect('['))
+			{
+				return false;
+			}
+			while (!expect(']'))
+			{
+				double sample;
+				if (!parse_number(sample))
+				{
+					return false;
+				}
+				record.samples.push_back(sample);
+				expect(',');
+			}
+		}
+		else if (at < line.size() && line[at] == '"')
+		{
+			std::string value;
+			if (!parse_string(value))
+			{
+				return false;
+			}
+			if (key == "run") record.run = value;
+			else if (key == "revision") record.revision = value;
+			else if (key == "host") record.host = value;
+			else if (key == "benchmark") { record.benchmark = value; has_benchmark = true; }
+		}
+		else
+		{
+			double ignored;
+			if (!parse_number(ignored))
+			{
+				return false;
+			}
+		}
+		expect(',');
+	}
+	return has_benchmark && !record.samples.empty();
+}
+
+
+// Append records to the history at path, one line each; returns false if it cannot be written.
+inline bool append_benchmark_history(const std::string& path, const std::vector<BenchmarkRecord>& records)
+{
+	std::ofstream out(path, std::ios::app);
+	for (const BenchmarkRecord& record : records)
+	{
+		out << format_benchmark_record(record) << '\n';
+	}
+	return bool(out);
+}
+
+// Every record in the history at path, in the order written; lines that are not records are skipped.
+inline std::vector<BenchmarkRecord> load_benchmark_history(const std::string& path)
+{
+	std::vector<BenchmarkRecord> history;
+	std::ifstream in(path);
+	BenchmarkRecord record;
+	for (std::string line; std::getline(in, line); )
+	{
+		if (parse_benchmark_record(line, record))
+		{
+			history.push_back(record);
+		}
+	}
+	return history;
+}
+
+// Run ids in the history in the order first written.
+inline std::vector<std::string> benchmark_runs(const std::vector<BenchmarkRecord>& history)
+{
+	std::vector<std::string> runs;
+	for (const BenchmarkRecord& record : history)
+	{
+		if (std::find(runs.begin(), runs.end(), record.run) == runs.end())
+		{
+			runs.push_back(record.run);
+		}
+	}
+	return runs;
+}
+
+
+// Probability of seeing samples b rank at least this far above samples a if both came from
+// one distribution: the one-sided p-value of the Mann-Whitney U test, by the normal
+// approximation with tie and continuity corrections. 1 if either is empty.
+inline double mann_whitney_greater(const std::vector<double>& a, const std::vector<double>& b)
+{
+	size_t n = a.size(), m = b.size(), total = n + m;
+	if (n == 0 || m == 0)
+	{
+		return 1;
+	}
+
+	// (value, from b) pairs ranked together; ties share their mean rank
+	std::vector<std::pair<double, bool>> pooled;
+	for (double x : a) pooled.push_back(std::make_pair(x, false));
+	for (double x : b) pooled.push_back(std::make_pair(x, true));
+	std::sort(pooled.begin(), pooled.end());
+
+	double rank_sum_b = 0, tie_term = 0;
+	for (size_t i = 0; i < total; )
+	{
+		size_t j = i;
+		while (j < total && pooled[j].first == pooled[i].first)
+		{
+			j++;
+		}
+		double rank = (i + 1 + j) / 2.0, ties = double(j - i);
+		for (size_t k = i; k < j; k++)
+		{
+			rank_sum_b += pooled[k].second ? rank : 0;
+		}
+		tie_term += ties * ties * ties - ties;
+		i = j;
+	}
+
+	double u = rank_sum_b - m * (m + 1) / 2.0;
+	double mean = n * m / 2.0;
+	double variance = n * m / 12.0 * ((total + 1) - tie_term / (double(total) * (total - 1)));
+	if (variance <= 0)
+	{
+		return 1;
+	}
+	double z = (u - mean - 0.5) / std::sqrt(variance);
+	return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+
+// Median of samples, which must not be empty.
+inline double sample_median(std::vector<double> samples)
+{
+	std::sort(samples.begin(), samples.end());
+	size_t half = samples.size() / 2;
+	return samples.size() % 2 == 1 ? samples[half] : (samples[half - 1] + samples[half]) / 2;
+}
+
+
+// One benchmark of a comparison.
+struct BenchmarkComparison
+{
+	std::string benchmark;
+	double baseline_median;
+	double candidate_median;
+
+	// candidate_median / baseline_median
+	double ratio;
+
+	// One-sided p-value that the candidate is slower.
+	double p_value;
+
+	// p_value below alpha and ratio at least min_ratio.
+	bool slower;
+};
+
+
+// Compare each benchmark recorded in both run baseline and run candidate of history; see the top
+// of this file. Samples of a benchmark recorded more than once in a run are pooled.
+inline std::vector<BenchmarkComparison> compare_benchmark_runs
+(
+	const std::vector<BenchmarkRecord>& history,
+	const std::string& baseline,
+	const std::string& candidate,
+	double alpha = 0.01,
+	double min_ratio = 1.05
+)
+{
+	std::vector<std::string> benchmarks;
+	for (const BenchmarkRecord& record : history)
+	{
+		if (record.run == candidate && std::find(benchmarks.begin(), benchmarks.end(), record.benchmark) == benchmarks.end())
+		{
+			benchmarks.push_back(record.benchmark);
+		}
+	}
+
+	std::vector<BenchmarkComparison> comparisons;
+	for (const std::string& benchmark : benchmarks)
+	{
+		std::vector<double> before, after;
+		for (const BenchmarkRecord& record : history)
+		{
+			if (record.benchmark == benchmark && (record.run == baseline || record.run == candidate))
+			{
+				std::vector<double>& samples = record.run == baseline ? before : after;
+				samples.insert(samples.end(), record.samples.begin(), record.samples.end());
+			}
+		}
+		if (before.empty())
+		{
+			continue;
+		}
+
+		BenchmarkComparison comparison;
+		comparison.benchmark = benchmark;
+		comparison.baseline_median = sample_median(before);
+		comparison.candidate_median = sample_median(after);
+		comparison.ratio = comparison.candidate_median / comparison.baseline_median;
+		comparison.p_value = mann_whitney_greater(before, after);
+		comparison.slower = comparison.p_value < alpha && comparison.ratio >= min_ratio;
+		comparisons.push_back(comparison);
+	}
+	return comparisons;
+}
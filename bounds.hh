@@ -0,0 +1,379 @@
+///////////////////////////////////////////////////////////////////////////////
+// bounds.hh
+//
+// Fast upper and lower bounds on the best ride time within a budget.
+//
+// The upper bound is the Dantzig linear programming relaxation: take rides in
+// decreasing order of time per dollar, and a fraction of the first ride that
+// does not fit (the critical ride). The lower bound is the greedy
+// 1/2-approximation: the better of the rides before the critical ride, or the
+// single longest ride that fits on its own. Rides that cost more than the
+// budget are left out first; otherwise such a ride could be critical, and the
+// rides before it alone can be far from half the best time.
+//
+// For one budget, the critical ride is found by weighted-median selection in
+// expected O(n) time without sorting. For many budgets, a TimeFrontier sorts
+// the rides by ratio once, after which each bound costs O(log n).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+
+#include "maxtime.hh"
+#include "orderings.hh"
+#include "workspace.hh"
+
+
+// Rides ordered by decreasing time per dollar; ties keep the lower index first.
+// Compares by cross-multiplication so no division is needed.
+struct RideRatioGreater
+{
+	const int* costs;
+	const double* times;
+
+	bool operator()(size_t a, size_t b) const
+	{
+		double left = times[a] * costs[b], right = times[b] * costs[a];
+		return left > right || (left == right && a < b);
+	}
+};
+
+
+// Result of splitting rides at the critical ride of the LP relaxation.
+struct DantzigSplit
+{
+	// Total cost and time of the rides wholly inside the LP solution.
+	int prefix_cost;
+	double prefix_time;
+
+	// Number of those rides; they are order[0, prefix_count).
+	size_t prefix_count;
+
+	// Whether there is a critical ride; if so it is order[prefix_count].
+	bool has_critical;
+
+	// Value of the LP relaxation, an upper bound on the best time.
+	double upper_bound;
+};
+
+
+// Find the critical ride of the LP relaxation among n rides given as flat
+// cost and time arrays, by repeated weighted-median selection.
+// order must have room for n indices; on return it holds the rides with positive time
+// that fit the budget on their own, with the LP prefix first and the critical ride right
+// after it. Rides with no positive time or costing more than total_cost never help and are
+// left out. Expected O(n) time.
+inline DantzigSplit dantzig_split
+(
+	const int* costs,
+	const double* times,
+	size_t n,
+	int total_cost,
+	size_t* order
+)
+{
+	size_t m = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (times[i] > 0 && costs[i] <= total_cost)
+		{
+			order[m++] = i;
+		}
+	}
+
+	DantzigSplit split = { 0, 0, 0, false, 0 };
+	RideRatioGreater greater = { costs, times };
+	long capacity = std::max(total_cost, 0);
+
+	size_t lo = 0, hi = m;
+	while (lo < hi)
+	{
+		// partition [lo, hi) around its median ratio
+		size_t mid = lo + (hi - lo) / 2;
+		std::nth_element(order + lo, order + mid, order + hi, greater);
+
+		long left_cost = 0;
+		double left_time = 0;
+		for (size_t k = lo; k < mid; k++)
+		{
+			left_cost += costs[order[k]];
+			left_time += times[order[k]];
+		}
+
+		if (left_cost > capacity)
+		{
+			// critical ride is among the better half
+			hi = mid;
+		}
+		else if (left_cost + costs[order[mid]] > capacity)
+		{
+			// the median itself is critical
+			split.prefix_cost += left_cost;
+			split.prefix_time += left_time;
+			capacity -= left_cost;
+			split.has_critical = true;
+			lo = mid;
+			break;
+		}
+		else
+		{
+			// the better half and the median all fit; continue among the worse half
+			split.prefix_cost += left_cost + costs[order[mid]];
+			split.prefix_time += left_time + times[order[mid]];
+			capacity -= left_cost + costs[order[mid]];
+			lo = mid + 1;
+		}
+	}
+
+	split.prefix_count = lo;
+	split.upper_bound = split.prefix_time;
+	if (split.has_critical)
+	{
+		size_t critical = order[lo];
+		split.upper_bound += times[critical] * capacity / costs[critical];
+	}
+	return split;
+}
+
+
+// Upper bound on the best total time of rides within the total_cost budget,
+// from the LP relaxation. Expected O(n) time.
+inline double lp_upper_bound
+(
+	const RideVector& rides,
+	int total_cost
+)
+{
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+
+	int* costs;
+	double* times;
+	gather_ride_columns(rides, workspace, costs, times);
+	size_t* order = workspace.borrow<size_t>(rides.size());
+
+	return dantzig_split(costs, times, rides.size(), total_cost, order).upper_bound;
+}
+
+
+// Compute a selection of rides within the total_cost budget whose time is at least
+// half of the best possible: the better of the LP prefix or the single longest ride that fits.
+// Expected O(n) time.
+inline std::unique_ptr<RideVector> greedy_max_time
+(
+	const RideVector& rides,
+	int total_cost
+)
+{
+	std::unique_ptr<RideVector> result(new RideVector);
+
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+
+	int* costs;
+	double* times;
+	gather_ride_columns(rides, workspace, costs, times);
+	size_t* order = workspace.borrow<size_t>(rides.size());
+
+	DantzigSplit split = dantzig_split(costs, times, rides.size(), total_cost, order);
+
+	size_t best_single = rides.size();
+	for (size_t i = 0; i < rides.size(); i++)
+	{
+		if (costs[i] <= total_cost && times[i] > 0
+			&& (best_single == rides.size() || times[i] > times[best_single]))
+		{
+			best_single = i;
+		}
+	}
+
+	if (best_single != rides.size() && times[best_single] > split.prefix_time)
+	{
+		(*result).push_back(rides[best_single]);
+	}
+	else
+	{
+		for (size_t k = 0; k < split.prefix_count; k++)
+		{
+			(*result).push_back(rides[order[k]]);
+		}
+	}
+
+	return result;
+}
+
+
+// One corner of the piecewise-linear LP frontier:
+// the rides up to this point in ratio order cost exactly cost dollars and give time minutes.
+struct FrontierPoint
+{
+	int cost;
+	double time;
+};
+
+
+// Upper and lower bounds on the best ride time for every budget at once.
+// Building sorts the rides by ratio once, O(n log n), or takes the ratio and cost orders
+// from orderings if given; each query is then O(log n). The frontier keeps rides of every
+// cost, so when the critical ride alone costs more than a budget, a query also scans the
+// rides after it, skipping those that cannot fit, which is O(n) for that budget.
+class TimeFrontier
+{
+	//
+	public:
+
+		//
+		explicit TimeFrontier(const RideVector& rides, const RideOrderings* orderings = nullptr)
+		{
+			std::vector<int> costs(rides.size());
+			std::vector<double> times(rides.size());
+			std::vector<size_t> order, by_cost;
+			for (size_t i = 0; i < rides.size(); i++)
+			{
+				costs[i] = rides[i]->cost();
+				times[i] = rides[i]->time();
+			}
+			auto positive = [&](size_t i) { return times[i] > 0; };
+
+			if (orderings != nullptr)
+			{
+				assert(orderings->size() == rides.size());
+				std::copy_if(orderings->by_ratio().begin(), orderings->by_ratio().end(), std::back_inserter(order), positive);
+				std::copy_if(orderings->by_cost().begin(), orderings->by_cost().end(), std::back_inserter(by_cost), positive);
+			}
+			else
+			{
+				for (size_t i = 0; i < rides.size(); i++)
+				{
+					if (positive(i))
+					{
+						order.push_back(i);
+					}
+				}
+				RideRatioGreater greater = { costs.data(), times.data() };
+				std::sort(order.begin(), order.end(), greater);
+
+				by_cost = order;
+				std::sort(by_cost.begin(), by_cost.end(),
+					[&](size_t a, size_t b) { return costs[a] < costs[b]; });
+			}
+
+			// upper frontier corners, from the ratio-sorted prefix sums
+			_corners.push_back(FrontierPoint{ 0, 0 });
+			for (size_t i : order)
+			{
+				const FrontierPoint& last = _corners.back();
+				_corners.push_back(FrontierPoint{ last.cost + costs[i], last.time + times[i] });
+			}
+
+			// best single ride for each budget, from rides sorted by cost
+			for (size_t i : by_cost)
+			{
+				if (!_singles.empty() && _singles.back().cost == costs[i])
+				{
+					_singles.back().time = std::max(_singles.back().time, times[i]);
+				}
+				else
+				{
+					double best = _singles.empty() ? 0 : _singles.back().time;
+					_singles.push_back(FrontierPoint{ costs[i], std::max(best, times[i]) });
+				}
+			}
+		}
+
+		// LP relaxation bound for the given budget; never less than the best time.
+		double upper(int total_cost) const
+		{
+			if (total_cost <= 0)
+			{
+				return 0;
+			}
+
+			double result;
+			long room;
+			size_t critical = fitting_prefix(total_cost, result, room);
+			if (critical < _corners.size())
+			{
+				const FrontierPoint& before = _corners[critical - 1];
+				const FrontierPoint& after = _corners[critical];
+				result += (after.time - before.time) * room / (after.cost - before.cost);
+			}
+			return result;
+		}
+
+		// Greedy 1/2-approximation for the given budget; never more than the best time.
+		double lower(int total_cost) const
+		{
+			if (total_cost <= 0)
+			{
+				return 0;
+			}
+
+			double result;
+			long room;
+			fitting_prefix(total_cost, result, room);
+
+			auto single = std::upper_bound(_singles.begin(), _singles.end(), total_cost,
+				[](int budget, const FrontierPoint& point) { return budget < point.cost; });
+			if (single != _singles.begin())
+			{
+				result = std::max(result, (single - 1)->time);
+			}
+			return result;
+		}
+
+		// Corners of the upper frontier over all rides, in increasing cost. Between two
+		// corners the upper bound is linear, for budgets at least the cost of the ride
+		// joining them.
+		const std::vector<FrontierPoint>& upper_corners() const { return _corners; }
+
+	//
+	private:
+
+		// Index of the last corner whose cost is within the budget.
+		size_t last_corner_within(int total_cost) const
+		{
+			auto after = std::upper_bound(_corners.begin(), _corners.end(), total_cost,
+				[](int budget, const FrontierPoint& point) { return budget < point.cost; });
+			return (after - _corners.begin()) - 1;
+		}
+
+		// The LP prefix among the rides that fit total_cost on their own: sets its time and
+		// the budget left after it, and returns the corner ending at the critical ride, or
+		// the number of corners if there is none. Ride k joins corners k and k + 1.
+		size_t fitting_prefix(int total_cost, double& time, long& room) const
+		{
+			size_t k = last_corner_within(total_cost);
+			time = _corners[k].time;
+			room = total_cost - _corners[k].cost;
+
+			// the rides up to corner k fit together; past it, skip every ride that does
+			// not fit on its own, and stop at the first one that does but not in the room left
+			for (size_t next = k + 1; next < _corners.size(); next++)
+			{
+				int cost = _corners[next].cost - _corners[next - 1].cost;
+				if (cost > total_cost)
+				{
+					continue;
+				}
+				if (cost > room)
+				{
+					return next;
+				}
+				room -= cost;
+				time += _corners[next].time - _corners[next - 1].time;
+			}
+			return _corners.size();
+		}
+
+		std::vector<FrontierPoint> _corners;
+		std::vector<FrontierPoint> _singles;
+};
@@ -0,0 +1,449 @@
+///////////////////////////////////////////////////////////////////////////////
+// branch_bound.hh
+//
+// Compute the optimal set of rides with a parallel branch-and-bound, a third
+// exact engine alongside exhaustive_max_time and dynamic_max_time that needs
+// no table over the budget.
+//
+// Rides are branched on in decreasing order of time per dollar, and each node
+// is bounded by the LP relaxation of the rides after it, which prefix sums make
+// O(log n). The search starts best-first from a shared priority queue until
+// every worker has a few subtrees. From then on each worker runs bound-guided
+// depth-first search from its own deque: the child with the better bound is
+// expanded first, and idle workers steal the shallowest node from the front of
+// another worker's deque. A worker whose deque reaches node_limit stops
+// pushing nodes and dives recursively instead, which caps memory. The best
+// selection is shared through a SharedIncumbent.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+#include "bounds.hh"
+#include "incumbent.hh"
+#include "maxtime.hh"
+#include "orderings.hh"
+#include "parallel_report.hh"
+
+
+// Search state shared by the workers of branch_bound_max_time.
+// Rides are renumbered by position in decreasing time-per-dollar order.
+class BranchBoundSearch
+{
+	//
+	public:
+
+		// A ride taken on the way to a node; nodes share the decisions of their ancestors.
+		struct Decision
+		{
+			size_t position;
+			std::shared_ptr<const Decision> parent;
+		};
+
+		// An open subtree: rides before position are decided.
+		struct Node
+		{
+			size_t position;
+			long capacity;
+			double time;
+			double bound;
+			std::shared_ptr<const Decision> taken;
+		};
+
+		//
+		BranchBoundSearch
+		(
+			const RideVector& rides,
+			int total_cost,
+			size_t threads,
+			size_t node_limit,
+			SharedIncumbent& incumbent,
+			const RideOrderings* orderings = nullptr
+		)
+			:
+			_incumbent(incumbent),
+			_total_cost(total_cost),
+			_node_limit(node_limit),
+			_deques(threads),
+			_pending(0)
+		{
+			std::vector<int> costs(rides.size());
+			std::vector<double> times(rides.size());
+			for (size_t i = 0; i < rides.size(); i++)
+			{
+				costs[i] = rides[i]->cost();
+				times[i] = rides[i]->time();
+			}
+			auto candidate = [&](size_t i) { return times[i] > 0 && costs[i] <= total_cost; };
+			if (orderings != nullptr)
+			{
+				assert(orderings->size() == rides.size());
+				std::copy_if(orderings->by_ratio().begin(), orderings->by_ratio().end(), std::back_inserter(_original), candidate);
+			}
+			else
+			{
+				for (size_t i = 0; i < rides.size(); i++)
+				{
+					if (candidate(i))
+					{
+						_original.push_back(i);
+					}
+				}
+				RideRatioGreater greater = { costs.data(), times.data() };
+				std::sort(_original.begin(), _original.end(), greater);
+			}
+
+			_size = _original.size();
+			_costs.resize(_size);
+			_times.resize(_size);
+			_prefix_costs.assign(_size + 1, 0);
+			_prefix_times.assign(_size + 1, 0);
+			for (size_t p = 0; p < _size; p++)
+			{
+				_costs[p] = costs[_original[p]];
+				_times[p] = times[_original[p]];
+				_prefix_costs[p + 1] = _prefix_costs[p] + _costs[p];
+				_prefix_times[p + 1] = _prefix_times[p] + _times[p];
+			}
+		}
+
+		// Offer the greedy selection, every ride that still fits in ratio order, as the first incumbent.
+		void seed_greedy()
+		{
+			long capacity = _total_cost;
+			double time = 0;
+			std::vector<size_t> selection;
+			for (size_t p = 0; p < _size; p++)
+			{
+				if (_costs[p] <= capacity)
+				{
+					capacity -= _costs[p];
+					time += _times[p];
+					selection.push_back(_original[p]);
+				}
+			}
+			_incumbent.offer(time, selection);
+		}
+
+		// Expand the best nodes first until there are per_worker open nodes for each
+		// worker, then deal them out round-robin.
+		void ramp_up(size_t per_worker)
+		{
+			auto lower_bound_first = [](const Node& a, const Node& b) { return a.bound < b.bound; };
+			std::priority_queue<Node, std::vector<Node>, decltype(lower_bound_first)> open(lower_bound_first);
+			open.push(Node{ 0, _total_cost, 0, bound(0, _total_cost, 0), nullptr });
+
+			std::vector<Node> children;
+			while (!open.empty() && open.size() < per_worker * _deques.size())
+			{
+				Node node = open.top();
+				open.pop();
+				children.clear();
+				expand(node, children);
+				for (Node& child : children)
+				{
+					open.push(child);
+				}
+			}
+
+			for (size_t k = 0; !open.empty(); k++)
+			{
+				push(k % _deques.size(), open.top());
+				open.pop();
+			}
+		}
+
+		// Worker loop: work from the own deque, steal when it is empty,
+		// and stop once no node is left anywhere. Returns the CPU seconds
+		// spent looking for work while there was none.
+		double work(size_t worker)
+		{
+			std::vector<Node> children;
+			std::vector<size_t> dive;
+			Node node;
+			double spin = 0, idle_since = -1;
+			while (_pending.load() > 0)
+			{
+				if (!pop(worker, node) && !steal(worker, node))
+				{
+					if (idle_since < 0)
+					{
+						idle_since = ThreadCpuTimer::now();
+					}
+					std::this_thread::yield();
+					continue;
+				}
+				if (idle_since >= 0)
+				{
+					spin += ThreadCpuTimer::now() - idle_since;
+					idle_since = -1;
+				}
+
+				if (_deques[worker].size() >= _node_limit)
+				{
+					// deque is full; finish this subtree without pushing anything
+					dive.clear();
+					search(node.position, node.capacity, node.time, node.taken, dive);
+				}
+				else
+				{
+					children.clear();
+					expand(node, children);
+
+					// the better child goes on last, so it is popped next
+					std::sort(children.begin(), children.end(),
+						[](const Node& a, const Node& b) { return a.bound < b.bound; });
+					for (Node& child : children)
+					{
+						push(worker, child);
+					}
+				}
+				_pending.fetch_sub(1);
+			}
+			if (idle_since >= 0)
+			{
+				spin += ThreadCpuTimer::now() - idle_since;
+			}
+			return spin;
+		}
+
+	//
+	private:
+
+		// A worker's double-ended queue: the owner works at the back, thieves take from the front.
+		struct WorkDeque
+		{
+			std::mutex mutex;
+			std::deque<Node> nodes;
+
+			size_t size()
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				return nodes.size();
+			}
+		};
+
+		// LP bound of a node at position p with the given capacity and time so far.
+		double bound(size_t p, long capacity, double time) const
+		{
+			// last k whose rides p .. k - 1 all fit
+			long limit = _prefix_costs[p] + capacity;
+			size_t k = std::upper_bound(_prefix_costs.begin() + p, _prefix_costs.end(), limit)
+				- _prefix_costs.begin() - 1;
+			double result = time + _prefix_times[k] - _prefix_times[p];
+			if (k < _size)
+			{
+				result += _times[k] * (limit - _prefix_costs[k]) / _costs[k];
+			}
+			return result;
+		}
+
+		// Bounds are sums of doubles; treat a gain below rounding as no gain.
+		bool beats_incumbent(double value) const
+		{
+			double incumbent = _incumbent.time();
+			return value > incumbent + 1e-9 * std::max(1.0, incumbent);
+		}
+
+		void offer(double time, const std::shared_ptr<const Decision>& taken, const std::vector<size_t>& dive)
+		{
+			if (!beats_incumbent(time))
+			{
+				return;
+			}
+			std::vector<size_t> selection;
+			for (const Decision* d = taken.get(); d != nullptr; d = d->parent.get())
+			{
+				selection.push_back(_original[d->position]);
+			}
+			for (size_t p : dive)
+			{
+				selection.push_back(_original[p]);
+			}
+			_incumbent.offer(time, selection);
+		}
+
+		// First position at or after p whose ride fits, or _size.
+		size_t next_candidate(size_t p, long capacity) const
+		{
+			while (p < _size && _costs[p] > capacity)
+			{
+				p++;
+			}
+			return p;
+		}
+
+		// Children of a node that may still beat the incumbent.
+		void expand(const Node& node, std::vector<Node>& children)
+		{
+			if (!beats_incumbent(node.bound))
+			{
+				return;
+			}
+			offer(node.time, node.taken, std::vector<size_t>());
+
+			size_t p = next_candidate(node.position, node.capacity);
+			if (p == _size)
+			{
+				return;
+			}
+
+			Node include{ p + 1, node.capacity - _costs[p], node.time + _times[p], 0,
+				std::make_shared<const Decision>(Decision{ p, node.taken }) };
+			include.bound = bound(include.position, include.capacity, include.time);
+			if (beats_incumbent(include.bound))
+			{
+				children.push_back(include);
+			}
+
+			Node exclude{ p + 1, node.capacity, node.time, bound(p + 1, node.capacity, node.time), node.taken };
+			if (beats_incumbent(exclude.bound))
+			{
+				children.push_back(exclude);
+			}
+		}
+
+		// Recursive depth-first search used once a deque is full; dive holds the rides taken
+		// below the node that started it.
+		void search(size_t p, long capacity, double time, const std::shared_ptr<const Decision>& taken, std::vector<size_t>& dive)
+		{
+			offer(time, taken, dive);
+			while ((p = next_candidate(p, capacity)) < _size && beats_incumbent(bound(p, capacity, time)))
+			{
+				dive.push_back(p);
+				search(p + 1, capacity - _costs[p], time + _times[p], taken, dive);
+				dive.pop_back();
+				p++;
+			}
+		}
+
+		void push(size_t worker, const Node& node)
+		{
+			_pending.fetch_add(1);
+			std::lock_guard<std::mutex> lock(_deques[worker].mutex);
+			_deques[worker].nodes.push_back(node);
+		}
+
+		bool pop(size_t worker, Node& node)
+		{
+			std::lock_guard<std::mutex> lock(_deques[worker].mutex);
+			if (_deques[worker].nodes.empty())
+			{
+				return false;
+			}
+			node = _deques[worker].nodes.back();
+			_deques[worker].nodes.pop_back();
+			return true;
+		}
+
+		bool steal(size_t thief, Node& node)
+		{
+			for (size_t k = 1; k < _deques.size(); k++)
+			{
+				WorkDeque& victim = _deques[(thief + k) % _deques.size()];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (!victim.nodes.empty())
+				{
+					node = victim.nodes.front();
+					victim.nodes.pop_front();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		SharedIncumbent& _incumbent;
+		long _total_cost;
+		size_t _node_limit;
+		size_t _size;
+		std::vector<size_t> _original;
+		std::vector<int> _costs;
+		std::vector<double> _times;
+		std::vector<long> _prefix_costs;
+		std::vector<double> _prefix_times;
+		std::vector<WorkDeque> _deques;
+		std::atomic<long> _pending;
+};
+
+
+// Compute the optimal set of ride items within the total_cost budget by parallel branch-and-bound.
+// threads is the number of worker threads; 0 means one per hardware thread.
+// node_limit caps the open nodes each worker keeps before it falls back to plain depth-first search.
+// orderings, if given, must be for rides; its ratio order is used instead of sorting.
+// If report is not null, the serial setup and the parallel search are added to it, the
+// search with the time workers spent out of work as spin.
+// The selection is empty if total_cost is negative.
+inline std::unique_ptr<RideVector> branch_bound_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	size_t threads = 0,
+	size_t node_limit = 4096,
+	const RideOrderings* orderings = nullptr,
+	ParallelReport* report = nullptr
+)
+{
+	// the bounds assume a budget of at least zero
+	if (total_cost < 0)
+	{
+		return std::unique_ptr<RideVector>(new RideVector);
+	}
+
+	if (threads == 0)
+	{
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	SharedIncumbent incumbent;
+	std::unique_ptr<BranchBoundSearch> search;
+	{
+		ParallelPhase phase(report, "branch_bound setup", 1);
+		ThreadCpuTimer setup_cpu;
+		search.reset(new BranchBoundSearch(rides, total_cost, threads, node_limit, incumbent, orderings));
+		search->seed_greedy();
+		search->ramp_up(4);
+		phase.record_thread(0, setup_cpu.elapsed());
+	}
+
+	{
+		ParallelPhase phase(report, "branch_bound search", threads);
+		auto worker = [&search, &phase](size_t t)
+		{
+			ThreadCpuTimer cpu;
+			double spin = search->work(t);
+			phase.record_thread(t, cpu.elapsed(), spin);
+		};
+		std::vector<std::thread> pool;
+		for (size_t t = 1; t < threads; t++)
+		{
+			pool.emplace_back(worker, t);
+		}
+		worker(0);
+		for (std::thread& thread : pool)
+		{
+			thread.join();
+		}
+	}
+
+	std::vector<size_t> selection = incumbent.selection();
+	std::sort(selection.begin(), selection.end());
+
+	std::unique_ptr<RideVector> result(new RideVector);
+	for (size_t i : selection)
+	{
+		(*result).push_back(rides[i]);
+	}
+	return result;
+}
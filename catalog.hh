@@ -0,0 +1,351 @@
+///////////////////////////////////////////////////////////////////////////////
+// catalog.hh
+//
+// Immutable, versioned ride catalogs for cheap what-if edits.
+//
+// A RideCatalog stores its rides as columns (the RideItem objects, costs,
+// times, and whether each ride is still offered), each split into chunks of
+// CATALOG_CHUNK_SIZE rides held by shared_ptr. Deriving a new version copies
+// only the chunks an edit touches; every other chunk is shared with the parent
+// version. A version with k edits costs O(k + chunks touched) plus one pointer
+// per chunk for the chunk tables.
+//
+// Each version has a unique number and remembers its ancestors, so caches of
+// solver results can be keyed by version and reused along a lineage.
+//
+// How to use:
+//
+//    RideCatalog base(*load_ride_database("ride.csv"));
+//    RideCatalog::Edit edit(base);
+//    edit.set_cost(17, 40);
+//    edit.remove(42);
+//    RideCatalog what_if = edit.commit();
+//    auto best = dynamic_max_time(*what_if.rides(), 500);
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+#include "maxtime.hh"
+#include "orderings.hh"
+
+
+// Number of rides per chunk of a catalog column.
+const size_t CATALOG_CHUNK_SIZE = 256;
+
+
+// One column of a catalog, split into shared, copy-on-write chunks.
+template <typename T>
+class ChunkedColumn
+{
+	//
+	public:
+
+		typedef std::vector<T> Chunk;
+
+		//
+		ChunkedColumn() : _size(0) { }
+
+		//
+		size_t size() const { return _size; }
+
+		//
+		const T& operator[](size_t i) const
+		{
+			assert(i < _size);
+			return (*_chunks[i / CATALOG_CHUNK_SIZE])[i % CATALOG_CHUNK_SIZE];
+		}
+
+		// Number of chunks, and a chunk by number, for comparing versions.
+		size_t chunk_count() const { return _chunks.size(); }
+		const Chunk* chunk(size_t k) const { return _chunks[k].get(); }
+
+		// Writable access to element i. owned marks chunks already copied by the
+		// current edit; a chunk not yet owned is copied first, leaving the original
+		// to the versions that share it.
+		T& writable(size_t i, std::vector<bool>& owned)
+		{
+			assert(i < _size);
+			size_t k = i / CATALOG_CHUNK_SIZE;
+			if (owned.size() < _chunks.size())
+			{
+				owned.resize(_chunks.size(), false);
+			}
+			if (!owned[k])
+			{
+				_chunks[k] = std::make_shared<Chunk>(*_chunks[k]);
+				owned[k] = true;
+			}
+			return (*_chunks[k])[i % CATALOG_CHUNK_SIZE];
+		}
+
+		// Append an element, copying the last chunk only if it is shared.
+		void push_back(const T& value, std::vector<bool>& owned)
+		{
+			if (_size % CATALOG_CHUNK_SIZE == 0)
+			{
+				_chunks.push_back(std::make_shared<Chunk>());
+				_chunks.back()->reserve(CATALOG_CHUNK_SIZE);
+				owned.resize(_chunks.size(), false);
+				owned.back() = true;
+			}
+			else
+			{
+				writable(_size - 1, owned);
+			}
+			_chunks.back()->push_back(value);
+			_size++;
+		}
+
+	//
+	private:
+
+		std::vector<std::shared_ptr<Chunk>> _chunks;
+		size_t _size;
+};
+
+
+// An immutable version of the ride catalog.
+// Ride indices are stable across versions: removing a ride leaves its slot
+// empty, and added rides take new slots at the end.
+class RideCatalog
+{
+	//
+	public:
+
+		// Changes to a catalog, applied together by commit(); defined below.
+		class Edit;
+
+		// The first version of a catalog, holding the given rides.
+		explicit RideCatalog(const RideVector& rides)
+			:
+			_version(next_version()),
+			_orderings(std::make_shared<OrderingsSlot>()),
+			_live(0)
+		{
+			std::vector<bool> owned_items, owned_costs, owned_times, owned_offered;
+			for (auto& ride : rides)
+			{
+				_items.push_back(ride, owned_items);
+				_costs.push_back(ride->cost(), owned_costs);
+				_times.push_back(ride->time(), owned_times);
+				_offered.push_back(true, owned_offered);
+				_live++;
+			}
+		}
+
+		// Number of ride slots, including removed rides.
+		size_t size() const { return _items.size(); }
+
+		// Number of rides still offered.
+		size_t live_count() const { return _live; }
+
+		//
+		bool offered(size_t i) const { return _offered[i]; }
+		int cost(size_t i) const { return _costs[i]; }
+		double time(size_t i) const { return _times[i]; }
+		const std::shared_ptr<RideItem>& item(size_t i) const { return _items[i]; }
+
+		// The rides still offered, in index order. Items are shared, not copied.
+		std::unique_ptr<RideVector> rides() const
+		{
+			std::unique_ptr<RideVector> result(new RideVector);
+			(*result).reserve(_live);
+			for (size_t i = 0; i < size(); i++)
+			{
+				if (_offered[i])
+				{
+					(*result).push_back(_items[i]);
+				}
+			}
+			return result;
+		}
+
+		// Sorted orders of rides(), built on first use and kept with this version;
+		// a version made by an Edit starts without them.
+		const RideOrderings& orderings() const
+		{
+			std::call_once(_orderings->built, [&]() { _orderings->orderings.reset(new RideOrderings(*rides())); });
+			return *_orderings->orderings;
+		}
+
+		// Unique number of this version.
+		uint64_t version() const { return _version; }
+
+		// Versions this one derives from, nearest first.
+		std::vector<uint64_t> ancestors() const
+		{
+			std::vector<uint64_t> result;
+			for (const Lineage* l = _lineage.get(); l != nullptr; l = l->parent.get())
+			{
+				result.push_back(l->version);
+			}
+			return result;
+		}
+
+		// Whether this version is the given one or derives from it.
+		bool descends_from(uint64_t version) const
+		{
+			if (version == _version)
+			{
+				return true;
+			}
+			for (const Lineage* l = _lineage.get(); l != nullptr; l = l->parent.get())
+			{
+				if (l->version == version)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Number of column chunks this version shares with other, out of all its chunks.
+		size_t shared_chunks(const RideCatalog& other) const
+		{
+			return count_shared(_items, other._items) + count_shared(_costs, other._costs)
+				+ count_shared(_times, other._times) + count_shared(_offered, other._offered);
+		}
+
+	//
+	private:
+
+		// A link in the chain of ancestors.
+		struct Lineage
+		{
+			uint64_t version;
+			std::shared_ptr<const Lineage> parent;
+		};
+
+		// Orderings of one version, shared by its copies.
+		struct OrderingsSlot
+		{
+			std::once_flag built;
+			std::unique_ptr<RideOrderings> orderings;
+		};
+
+		static uint64_t next_version()
+		{
+			static std::atomic<uint64_t> counter(0);
+			return ++counter;
+		}
+
+		template <typename T>
+		static size_t count_shared(const ChunkedColumn<T>& a, const ChunkedColumn<T>& b)
+		{
+			size_t count = 0;
+			for (size_t k = 0; k < a.chunk_count() && k < b.chunk_count(); k++)
+			{
+				count += a.chunk(k) == b.chunk(k);
+			}
+			return count;
+		}
+
+		uint64_t _version;
+		std::shared_ptr<const Lineage> _lineage;
+		std::shared_ptr<OrderingsSlot> _orderings;
+		ChunkedColumn<std::shared_ptr<RideItem>> _items;
+		ChunkedColumn<int> _costs;
+		ChunkedColumn<double> _times;
+		ChunkedColumn<char> _offered;
+		size_t _live;
+};
+
+
+// Changes to a catalog, applied together by commit().
+class RideCatalog::Edit
+{
+	//
+	public:
+
+		// Start editing from the given version.
+		explicit Edit(const RideCatalog& base)
+			:
+			_next(base)
+		{
+			_next._version = next_version();
+			_next._lineage = std::make_shared<const Lineage>(Lineage{ base._version, base._lineage });
+			_next._orderings = std::make_shared<OrderingsSlot>();
+		}
+
+		// Change the cost of ride i.
+		void set_cost(size_t i, int cost)
+		{
+			assert(cost > 0);
+			_next._costs.writable(i, _owned_costs) = cost;
+			replace_item(i);
+		}
+
+		// Change the time of ride i.
+		void set_time(size_t i, double time)
+		{
+			_next._times.writable(i, _owned_times) = time;
+			replace_item(i);
+		}
+
+		// Stop offering ride i.
+		void remove(size_t i)
+		{
+			if (_next._offered[i])
+			{
+				_next._offered.writable(i, _owned_offered) = false;
+				_next._live--;
+			}
+		}
+
+		// Offer a new ride; returns its index.
+		size_t add(const std::string& description, int cost, double time)
+		{
+			size_t i = _next._items.size();
+			_next._items.push_back(std::make_shared<RideItem>(description, cost, time), _owned_items);
+			_next._costs.push_back(cost, _owned_costs);
+			_next._times.push_back(time, _owned_times);
+			_next._offered.push_back(true, _owned_offered);
+			_next._live++;
+			return i;
+		}
+
+		// Number of ride slots, and whether ride i is offered, with the edits so far.
+		size_t size() const { return _next.size(); }
+		bool offered(size_t i) const { return _next.offered(i); }
+
+		// The new version. Further edits start a version after it, and copy
+		// any chunk they touch again rather than change the committed one.
+		RideCatalog commit()
+		{
+			RideCatalog result = _next;
+			_owned_items.clear();
+			_owned_costs.clear();
+			_owned_times.clear();
+			_owned_offered.clear();
+			_next._version = next_version();
+			_next._lineage = std::make_shared<const Lineage>(Lineage{ result._version, result._lineage });
+			_next._orderings = std::make_shared<OrderingsSlot>();
+			return result;
+		}
+
+	//
+	private:
+
+		// RideItem has no setters, so an edited ride gets a new item.
+		void replace_item(size_t i)
+		{
+			const RideItem& old = *_next._items[i];
+			_next._items.writable(i, _owned_items) =
+				std::make_shared<RideItem>(old.description(), _next._costs[i], _next._times[i]);
+		}
+
+		RideCatalog _next;
+		std::vector<bool> _owned_items, _owned_costs, _owned_times, _owned_offered;
+};
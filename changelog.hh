@@ -0,0 +1,552 @@
+///////////////////////////////////////////////////////////////////////////////
+// changelog.hh
+//
+// An append-only binary log of catalog changes kept next to the ride.csv
+// snapshot, so small updates do not rewrite or re-parse the whole catalog.
+//
+// Loading reads the snapshot with load_ride_database and replays the log on
+// top of it. Each update is appended to the log, applied to the in-memory
+// RideCatalog, and passed to subscribers. Compaction runs in the background:
+// it writes the live rides as a new snapshot and starts a new log holding only
+// the records that arrived meanwhile.
+//
+// Log file layout (all integers little-endian):
+//
+//    header:  8-byte magic "RIDELOG1"
+//             u64 byte size of the snapshot the log applies to
+//             u64 number of rides in that snapshot
+//    records: u32 length of the rest of the record
+//             u8 kind, u32 ride index, i32 cost, u64 bits of the time as a double
+//             u16 description length, then the description bytes
+//
+// Ride indices count the snapshot's rides first, then each added ride in turn;
+// removed rides keep their index until the next compaction, which renumbers
+// the remaining rides in order. A log whose header does not match the
+// snapshot is refused rather than replayed onto the wrong rides. A torn
+// record at the end of the log is ignored.
+//
+// Compaction writes the new snapshot and log next to the old ones, with a
+// ".compacting" suffix, then renames the snapshot and then the log into
+// place. Renaming the snapshot commits it: load() discards the new files if
+// the snapshot was not renamed, and renames the new log into place if only
+// the log was not, so a crash at any point leaves a pair that loads.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+#include "catalog.hh"
+#include "maxtime.hh"
+
+
+// What a change log record does.
+enum ChangeKind
+{
+	CHANGE_ADD = 1,
+	CHANGE_REMOVE = 2,
+	CHANGE_REPRICE = 3,
+	CHANGE_RETIME = 4,
+
+	// Not stored; tells subscribers that compaction renumbered the rides.
+	CHANGE_COMPACTED = 5
+};
+
+
+// One change to the catalog.
+struct ChangeRecord
+{
+	ChangeKind kind;
+
+	// Ride changed; for CHANGE_ADD, the index the new ride receives.
+	uint32_t index;
+
+	// New cost, for CHANGE_ADD and CHANGE_REPRICE.
+	int32_t cost;
+
+	// New time, for CHANGE_ADD and CHANGE_RETIME.
+	double time;
+
+	// Description, for CHANGE_ADD.
+	std::string description;
+};
+
+
+// Encode one record in the log file layout, appending it to out.
+inline void encode_change_record(const ChangeRecord& record, std::string& out)
+{
+	auto put = [&](uint64_t value, size_t bytes)
+	{
+		for (size_t b = 0; b < bytes; b++)
+		{
+			out.push_back(char((value >> (8 * b)) & 0xff));
+		}
+	};
+
+	uint64_t time_bits;
+	std::memcpy(&time_bits, &record.time, sizeof(time_bits));
+	size_t length = 1 + 4 + 4 + 8 + 2 + record.description.size();
+
+	put(length, 4);
+	put(record.kind, 1);
+	put(record.index, 4);
+	put(uint32_t(record.cost), 4);
+	put(time_bits, 8);
+	put(record.description.size(), 2);
+	out += record.description;
+}
+
+
+// Decode the record starting at offset in data, advancing offset past it.
+// Returns false, leaving offset alone, if data ends partway through the record.
+inline bool decode_change_record(const std::string& data, size_t& offset, ChangeRecord& record)
+{
+	size_t at = offset;
+	auto get = [&](size_t bytes)
+	{
+		uint64_t value = 0;
+		for (size_t b = 0; b < bytes; b++)
+		{
+			value |= uint64_t(uint8_t(data[at + b])) << (8 * b);
+		}
+		at += bytes;
+		return value;
+	};
+
+	if (data.size() - at < 4)
+	{
+		return false;
+	}
+	size_t length = get(4);
+	if (data.size() - at < length || length < 1 + 4 + 4 + 8 + 2)
+	{
+		return false;
+	}
+
+	record.kind = ChangeKind(get(1));
+	record.index = uint32_t(get(4));
+	record.cost = int32_t(uint32_t(get(4)));
+	uint64_t time_bits = get(8);
+	std::memcpy(&record.time, &time_bits, sizeof(time_bits));
+	size_t description_length = get(2);
+	if (length != 1 + 4 + 4 + 8 + 2 + description_length)
+	{
+		return false;
+	}
+	record.description = data.substr(at, description_length);
+	offset = at + description_length;
+	return true;
+}
+
+
+// A ride catalog backed by a snapshot file and a change log.
+class RideChangeLog
+{
+	//
+	public:
+
+		// Called with each change once it is durable, and with the catalog after it.
+		typedef std::function<void(const ChangeRecord&, const RideCatalog&)> Subscriber;
+
+		//
+		RideChangeLog
+		(
+			const std::string& snapshot_path,
+			const std::string& log_path
+		)
+			:
+			_snapshot_path(snapshot_path),
+			_log_path(log_path)
+		{
+		}
+
+		// Read the snapshot and replay the log; a missing log is started empty.
+		// Returns false on I/O error or when the log does not belong to the snapshot.
+		bool load()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			// a compaction that stopped before renaming its snapshot never happened
+			std::string snapshot_temp = _snapshot_path + ".compacting", log_temp = _log_path + ".compacting";
+			if (file_size(snapshot_temp) >= 0)
+			{
+				std::remove(snapshot_temp.c_str());
+				std::remove(log_temp.c_str());
+			}
+
+			std::unique_ptr<RideVector> rides = load_ride_database(_snapshot_path);
+			if (!rides)
+			{
+				return false;
+			}
+			std::string header = log_header(file_size(_snapshot_path), rides->size());
+			_catalog.reset(new RideCatalog(*rides));
+			_tail.clear();
+
+			// one that stopped after it only has its log left to rename, unless the log in place
+			// already belongs to the new snapshot
+			if (file_size(log_temp) >= 0)
+			{
+				if (log_starts_with(log_temp, header) && !log_starts_with(_log_path, header)
+					&& std::rename(log_temp.c_str(), _log_path.c_str()) != 0)
+				{
+					std::cout << "Failed to finish compaction of change log: " << _log_path << std::endl;
+					return false;
+				}
+				std::remove(log_temp.c_str());
+			}
+
+			std::ifstream in(_log_path, std::ios::binary);
+			if (!in)
+			{
+				return start_log(_log_path, header, _tail);
+			}
+			std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			if (data.compare(0, header.size(), header) != 0)
+			{
+				std::cout << "Failed to load change log; It does not belong to snapshot: " << _snapshot_path << std::endl;
+				return false;
+			}
+
+			// replay the complete records; a torn record at the end is dropped
+			RideCatalog::Edit edit(*_catalog);
+			size_t offset = header.size();
+			ChangeRecord record;
+			while (decode_change_record(data, offset, record))
+			{
+				if (apply(edit, record))
+				{
+					_tail.push_back(record);
+				}
+			}
+			_catalog.reset(new RideCatalog(edit.commit()));
+
+			if (offset != data.size())
+			{
+				return start_log(_log_path, header, _tail);
+			}
+			_out.open(_log_path, std::ios::binary | std::ios::app);
+			return bool(_out);
+		}
+
+		// Make a change: append it to the log, apply it, and tell subscribers.
+		// For CHANGE_ADD, the index field is ignored and set to the new ride's index, and the
+		// description must not contain '^' or a newline, which the snapshot could not hold,
+		// nor be longer than the log's 16-bit length field allows.
+		// Returns false if the change is invalid or could not be written.
+		bool append(ChangeRecord record)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			assert(_catalog);
+
+			if (record.kind == CHANGE_ADD)
+			{
+				record.index = _catalog->size();
+			}
+			RideCatalog::Edit edit(*_catalog);
+			if (!apply(edit, record))
+			{
+				return false;
+			}
+
+			std::string bytes;
+			encode_change_record(record, bytes);
+			_out.write(bytes.data(), bytes.size());
+			_out.flush();
+			if (!_out)
+			{
+				return false;
+			}
+
+			_catalog.reset(new RideCatalog(edit.commit()));
+			_tail.push_back(record);
+			for (Subscriber& subscriber : _subscribers)
+			{
+				subscriber(record, *_catalog);
+			}
+			return true;
+		}
+
+		// Call subscriber after every change and compaction.
+		// Subscribers run while the log is locked and must not call back into it.
+		void subscribe(Subscriber subscriber)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_subscribers.push_back(subscriber);
+		}
+
+		// The current catalog.
+		RideCatalog catalog() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			assert(_catalog);
+			return *_catalog;
+		}
+
+		// Number of records in the log since the last compaction.
+		size_t tail_size() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _tail.size();
+		}
+
+		// Write the live rides as a new snapshot and start a new log, on a background thread.
+		// Changes may keep arriving meanwhile; they are carried into the new log.
+		// The future holds whether compaction succeeded.
+		std::future<bool> compact_async()
+		{
+			return std::async(std::launch::async, [this]() { return compact(); });
+		}
+
+		// Same as compact_async, on the calling thread.
+		bool compact()
+		{
+			std::lock_guard<std::mutex> compacting(_compact_mutex);
+
+			// the slow part, writing the snapshot, runs without blocking appends
+			std::unique_ptr<RideCatalog> taken;
+			size_t seen;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				assert(_catalog);
+				taken.reset(new RideCatalog(*_catalog));
+				seen = _tail.size();
+			}
+			const RideCatalog& base = *taken;
+
+			std::string snapshot_temp = _snapshot_path + ".compacting";
+			std::unique_ptr<RideVector> live = base.rides();
+			if (!write_snapshot(snapshot_temp, *live))
+			{
+				std::remove(snapshot_temp.c_str());
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			// renumber: live rides in order, then rides added since the snapshot was taken
+			std::vector<int64_t> renumbered(base.size(), -1);
+			size_t next = 0;
+			for (size_t i = 0; i < base.size(); i++)
+			{
+				if (base.offered(i))
+				{
+					renumbered[i] = next++;
+				}
+			}
+			auto renumber = [&](uint32_t index) -> int64_t
+			{
+				return index < base.size() ? renumbered[index] : int64_t(index - base.size() + live->size());
+			};
+
+			std::vector<ChangeRecord> carried;
+			for (size_t k = seen; k < _tail.size(); k++)
+			{
+				ChangeRecord record = _tail[k];
+				int64_t index = renumber(record.index);
+				if (index >= 0)
+				{
+					record.index = uint32_t(index);
+					carried.push_back(record);
+				}
+			}
+
+			std::string header = log_header(file_size(snapshot_temp), live->size());
+			std::string log_temp = _log_path + ".compacting";
+			if (!start_log(log_temp, header, carried))
+			{
+				std::remove(snapshot_temp.c_str());
+				std::remove(log_temp.c_str());
+				return false;
+			}
+
+			// until the snapshot is renamed, a failure leaves the old snapshot, log and catalog in use
+			if (std::rename(snapshot_temp.c_str(), _snapshot_path.c_str()) != 0)
+			{
+				std::cout << "Failed to replace ride snapshot: " << _snapshot_path << std::endl;
+				std::remove(snapshot_temp.c_str());
+				std::remove(log_temp.c_str());
+				return false;
+			}
+
+			// after it, the new log must follow; failing a rename, write it in place
+			if (std::rename(log_temp.c_str(), _log_path.c_str()) == 0)
+			{
+				_out.close();
+				_out.open(_log_path, std::ios::binary | std::ios::app);
+			}
+			else if (start_log(_log_path, header, carried))
+			{
+				std::remove(log_temp.c_str());
+			}
+			else
+			{
+				// the old log no longer matches the snapshot; refuse appends until load()
+				// renames the new log into place
+				_out.close();
+			}
+
+			// rebuild the catalog in the new numbering
+			RideCatalog compacted(*live);
+			RideCatalog::Edit edit(compacted);
+			for (const ChangeRecord& record : carried)
+			{
+				apply(edit, record);
+			}
+			_catalog.reset(new RideCatalog(edit.commit()));
+			_tail = carried;
+
+			ChangeRecord notice = { CHANGE_COMPACTED, 0, 0, 0, "" };
+			for (Subscriber& subscriber : _subscribers)
+			{
+				subscriber(notice, *_catalog);
+			}
+			return _out.is_open() && bool(_out);
+		}
+
+	//
+	private:
+
+		static long file_size(const std::string& path)
+		{
+			std::ifstream f(path, std::ios::binary | std::ios::ate);
+			return f ? long(f.tellg()) : -1;
+		}
+
+		// Whether the file at path begins with header.
+		static bool log_starts_with(const std::string& path, const std::string& header)
+		{
+			std::ifstream f(path, std::ios::binary);
+			std::string start(header.size(), '\0');
+			return f.read(&start[0], start.size()) && start == header;
+		}
+
+		static std::string log_header(long snapshot_bytes, size_t snapshot_rides)
+		{
+			std::string header("RIDELOG1");
+			for (uint64_t value : { uint64_t(snapshot_bytes), uint64_t(snapshot_rides) })
+			{
+				for (size_t b = 0; b < 8; b++)
+				{
+					header.push_back(char((value >> (8 * b)) & 0xff));
+				}
+			}
+			return header;
+		}
+
+		// Write a whole log file: header and records.
+		bool start_log(const std::string& path, const std::string& header, const std::vector<ChangeRecord>& records)
+		{
+			std::string bytes(header);
+			for (const ChangeRecord& record : records)
+			{
+				encode_change_record(record, bytes);
+			}
+			{
+				std::ofstream f(path, std::ios::binary | std::ios::trunc);
+				f.write(bytes.data(), bytes.size());
+				if (!f)
+				{
+					std::cout << "Failed to write change log: " << path << std::endl;
+					return false;
+				}
+			}
+			if (path == _log_path)
+			{
+				_out.close();
+				_out.open(_log_path, std::ios::binary | std::ios::app);
+			}
+			return true;
+		}
+
+		// Write rides in the ride.csv format that load_ride_database reads.
+		static bool write_snapshot(const std::string& path, const RideVector& rides)
+		{
+			std::ofstream f(path, std::ios::trunc);
+			f << "Item^Cost^Time\n";
+			for (auto& ride : rides)
+			{
+				// shortest text that reads back as the same double
+				char time[32];
+				std::to_chars_result written = std::to_chars(time, time + sizeof(time), ride->time());
+				f << ride->description() << '^' << ride->cost() << '^' << std::string(time, written.ptr) << '\n';
+			}
+			f.close();
+			if (!f)
+			{
+				std::cout << "Failed to write ride snapshot: " << path << std::endl;
+				return false;
+			}
+			return true;
+		}
+
+		// Apply record to edit, checking it against the rides as edited so far.
+		static bool apply(RideCatalog::Edit& edit, const ChangeRecord& record)
+		{
+			switch (record.kind)
+			{
+				case CHANGE_ADD:
+					// the description becomes a field of the '^'-separated snapshot, one ride per
+					// line, and its length a u16 of the log record
+					if (record.cost <= 0 || record.description.empty() || record.description.size() > UINT16_MAX
+						|| record.description.find_first_of("^\n") != std::string::npos)
+					{
+						return false;
+					}
+					edit.add(record.description, record.cost, record.time);
+					return true;
+
+				case CHANGE_REMOVE:
+				case CHANGE_REPRICE:
+				case CHANGE_RETIME:
+					if (record.index >= edit.size() || !edit.offered(record.index))
+					{
+						return false;
+					}
+					if (record.kind == CHANGE_REMOVE)
+					{
+						edit.remove(record.index);
+					}
+					else if (record.kind == CHANGE_REPRICE)
+					{
+						if (record.cost <= 0)
+						{
+							return false;
+						}
+						edit.set_cost(record.index, record.cost);
+					}
+					else
+					{
+						edit.set_time(record.index, record.time);
+					}
+					return true;
+
+				default:
+					return false;
+			}
+		}
+
+		std::string _snapshot_path, _log_path;
+		mutable std::mutex _mutex;
+		std::mutex _compact_mutex;
+		std::unique_ptr<RideCatalog> _catalog;
+		std::vector<ChangeRecord> _tail;
+		std::vector<Subscriber> _subscribers;
+		std::ofstream _out;
+};
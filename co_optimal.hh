@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////
+// co_optimal.hh
+//
+// Enumerate every optimal selection of rides, not just the one that
+// dynamic_max_time or exhaustive_max_time happens to return.
+//
+// Ride times in ride.csv repeat (many are round numbers), so a budget often
+// has several optimal selections. This keeps the whole dynamic programming
+// table of best times, best[i][j] for the first i rides within j dollars,
+// and walks it back from (n, total_cost) depth first. At ride i - 1 it
+// follows each decision that can still reach the optimum: skipping, if
+// best[i - 1][j] does, and taking, if best[i - 1][j - cost] + time does. A
+// branch is only entered when the table proves it completes, so the walk has
+// no dead ends and each selection costs O(n) after the first, rather than a
+// fresh solve with the earlier answers excluded.
+//
+// Sums of the same times in different orders can round differently, so
+// selections within tolerance of the best time count as optimal. Rides with
+// zero time double the number of optima each time they fit; max_solutions
+// caps the walk.
+//
+// How to use:
+//
+//    auto optima = dynamic_co_optimal(*rides, 500);
+//    // every optima[k] has the greatest total time within $500
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <memory>
+#include <vector>
+
+
+#include "maxtime.hh"
+#include "workspace.hh"
+
+
+// Call visit(indices, count) for each selection of the n rides within total_cost whose
+// total time is within tolerance of the best, indices from the last ride to the first,
+// until visit returns false or max_solutions selections have been visited. Returns the
+// number visited. O(n * total_cost) to fill the table, which is borrowed from workspace,
+// then O(n) per selection.
+template <typename Visit>
+size_t for_each_co_optimal
+(
+	const int* costs,
+	const double* times,
+	size_t n,
+	int total_cost,
+	double tolerance,
+	size_t max_solutions,
+	SolverWorkspace& workspace,
+	Visit visit
+)
+{
+	if (total_cost < 0 || max_solutions == 0)
+	{
+		return 0;
+	}
+
+	SolverWorkspace::Frame frame(workspace);
+
+	// row i of the table holds best[i][0 .. total_cost]
+	size_t width = size_t(total_cost) + 1;
+	double* best = workspace.borrow_zeroed<double>((n + 1) * width);
+	uint64_t* unused_taken = workspace.borrow_zeroed<uint64_t>((width + 63) / 64);
+	for (size_t i = 0; i < n; i++)
+	{
+		dynamic_row_update(best + i * width, best + (i + 1) * width, unused_taken, total_cost, costs[i], times[i]);
+	}
+
+	// depth-first over (rides left, budget left, time still needed); each frame tries
+	// skipping and then taking ride rides - 1
+	struct Step
+	{
+		size_t rides;
+		int budget;
+		double needed;
+		int tried;
+		bool took;
+	};
+	std::vector<Step> stack;
+	std::vector<size_t> chosen;
+	stack.push_back(Step{ n, total_cost, best[n * width + total_cost], 0, false });
+
+	size_t visited = 0;
+	while (!stack.empty())
+	{
+		Step& step = stack.back();
+		if (step.rides == 0 || step.tried == 2)
+		{
+			if (step.rides == 0)
+			{
+				visited++;
+				if (!visit(chosen.data(), chosen.size()) || visited == max_solutions)
+				{
+					break;
+				}
+			}
+			if (step.took)
+			{
+				chosen.pop_back();
+			}
+			stack.pop_back();
+			continue;
+		}
+
+		size_t ride = step.rides - 1;
+		const double* row = best + ride * width;
+		if (step.tried++ == 0)
+		{
+			if (row[step.budget] >= step.needed - tolerance)
+			{
+				stack.push_back(Step{ ride, step.budget, step.needed, 0, false });
+			}
+		}
+		else
+		{
+			int cost = costs[ride];
+			if (cost <= step.budget && row[step.budget - cost] + times[ride] >= step.needed - tolerance)
+			{
+				chosen.push_back(ride);
+				stack.push_back(Step{ ride, step.budget - cost, step.needed - times[ride], 0, true });
+			}
+		}
+	}
+	return visited;
+}
+
+
+// Every optimal selection of rides within total_cost, up to max_solutions of them; see the
+// top of this file. Each selection lists its rides in the order of rides. Selections whose
+// time is within tolerance minutes of the best count as optimal.
+inline std::vector<std::unique_ptr<RideVector>> dynamic_co_optimal
+(
+	const RideVector& rides,
+	int total_cost,
+	size_t max_solutions = 1000,
+	double tolerance = 1e-6
+)
+{
+	std::vector<std::unique_ptr<RideVector>> optima;
+
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+	int* costs;
+	double* times;
+	gather_ride_columns(rides, workspace, costs, times);
+
+	for_each_co_optimal(costs, times, rides.size(), total_cost, tolerance, max_solutions, workspace,
+		[&](const size_t* indices, size_t count)
+		{
+			std::unique_ptr<RideVector> selection(new RideVector);
+			for (size_t k = count; k > 0; k--)
+			{
+				(*selection).push_back(rides[indices[k - 1]]);
+			}
+			optima.push_back(std::move(selection));
+			return true;
+		});
+	return optima;
+}
@@ -0,0 +1,519 @@
+///////////////////////////////////////////////////////////////////////////////
+// conflict.hh
+//
+// Choose rides within a budget when some pairs of rides cannot both be taken,
+// e.g. two rides sharing a queue, or shows at the same hour.
+//
+// The conflicts form a graph stored as one adjacency bitset per ride. The
+// solver is an exact depth-first branch-and-bound over the rides in order of
+// time per dollar. At each node the bound is the LP relaxation over the rides
+// that are still compatible with everything chosen so far, tightened when
+// needed by allowing at most one ride per clique of conflicts. The top of the
+// search tree is split into subtrees that worker threads take in turn, and
+// the best selection is shared between them through a SharedIncumbent.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+#include "bounds.hh"
+#include "incumbent.hh"
+#include "maxtime.hh"
+#include "orderings.hh"
+#include "parallel_report.hh"
+
+
+// Pairs of rides, by index into a RideVector, that cannot both be chosen.
+class ConflictGraph
+{
+	//
+	public:
+
+		// A graph on the given number of rides with no conflicts yet.
+		explicit ConflictGraph(size_t rides)
+			:
+			_size(rides),
+			_words((rides + 63) / 64),
+			_bits(rides * _words, 0)
+		{
+		}
+
+		// Forbid choosing both ride a and ride b.
+		void add_conflict(size_t a, size_t b)
+		{
+			assert(a < _size && b < _size && a != b);
+			_bits[a * _words + b / 64] |= uint64_t(1) << (b % 64);
+			_bits[b * _words + a / 64] |= uint64_t(1) << (a % 64);
+		}
+
+		//
+		bool conflicts(size_t a, size_t b) const
+		{
+			return (_bits[a * _words + b / 64] >> (b % 64)) & 1;
+		}
+
+		// Number of rides in the graph.
+		size_t size() const { return _size; }
+
+		// Adjacency bitset of ride a, words() 64-bit words long.
+		const uint64_t* row(size_t a) const { return &_bits[a * _words]; }
+		size_t words() const { return _words; }
+
+	//
+	private:
+
+		size_t _size, _words;
+		std::vector<uint64_t> _bits;
+};
+
+
+// Search state shared by the workers of conflict_max_time.
+// Rides are renumbered by position in decreasing time-per-dollar order.
+class ConflictSearch
+{
+	//
+	public:
+
+		// One subtree of the search, waiting for a worker.
+		struct Node
+		{
+			size_t position;
+			long capacity;
+			double time;
+			std::vector<size_t> chosen;
+			std::vector<uint64_t> banned;
+		};
+
+		//
+		ConflictSearch
+		(
+			const RideVector& rides,
+			int total_cost,
+			const ConflictGraph& conflicts,
+			SharedIncumbent& incumbent,
+			const RideOrderings* orderings = nullptr
+		)
+			:
+			_incumbent(incumbent),
+			_total_cost(total_cost)
+		{
+			std::vector<int> costs(rides.size());
+			std::vector<double> times(rides.size());
+			for (size_t i = 0; i < rides.size(); i++)
+			{
+				costs[i] = rides[i]->cost();
+				times[i] = rides[i]->time();
+			}
+			auto candidate = [&](size_t i) { return times[i] > 0 && costs[i] <= total_cost; };
+			if (orderings != nullptr)
+			{
+				assert(orderings->size() == rides.size());
+				std::copy_if(orderings->by_ratio().begin(), orderings->by_ratio().end(), std::back_inserter(_original), candidate);
+			}
+			else
+			{
+				for (size_t i = 0; i < rides.size(); i++)
+				{
+					if (candidate(i))
+					{
+						_original.push_back(i);
+					}
+				}
+				RideRatioGreater greater = { costs.data(), times.data() };
+				std::sort(_original.begin(), _original.end(), greater);
+			}
+
+			_size = _original.size();
+			_words = (_size + 63) / 64;
+			_costs.resize(_size);
+			_times.resize(_size);
+			std::vector<size_t> position(rides.size(), _size);
+			for (size_t p = 0; p < _size; p++)
+			{
+				position[_original[p]] = p;
+			}
+
+			// renumber each conflict row by position, walking only its set bits
+			_adjacency.assign(_size * _words, 0);
+			for (size_t p = 0; p < _size; p++)
+			{
+				_costs[p] = costs[_original[p]];
+				_times[p] = times[_original[p]];
+
+				const uint64_t* row = conflicts.row(_original[p]);
+				for (size_t w = 0; w < conflicts.words(); w++)
+				{
+					for (uint64_t bits = row[w]; bits != 0; bits &= bits - 1)
+					{
+						size_t q = position[w * 64 + __builtin_ctzll(bits)];
+						if (q != _size)
+						{
+							_adjacency[p * _words + q / 64] |= uint64_t(1) << (q % 64);
+						}
+					}
+				}
+			}
+
+			// partition the rides greedily into cliques, each kept in increasing cost
+			std::vector<bool> placed(_size, false);
+			for (size_t p = 0; p < _size; p++)
+			{
+				if (placed[p])
+				{
+					continue;
+				}
+				std::vector<size_t> clique(1, p);
+				placed[p] = true;
+				for (size_t q = p + 1; q < _size; q++)
+				{
+					bool adjacent_to_all = !placed[q];
+					for (size_t k = 0; adjacent_to_all && k < clique.size(); k++)
+					{
+						adjacent_to_all = is_banned(&_adjacency[clique[k] * _words], q);
+					}
+					if (adjacent_to_all)
+					{
+						clique.push_back(q);
+						placed[q] = true;
+					}
+				}
+				std::sort(clique.begin(), clique.end(), [&](size_t a, size_t b)
+				{
+					return _costs[a] < _costs[b] || (_costs[a] == _costs[b] && _times[a] > _times[b]);
+				});
+				_cliques.push_back(clique);
+			}
+		}
+
+		// The search tree root.
+		Node root() const
+		{
+			return Node{ 0, _total_cost, 0, std::vector<size_t>(), std::vector<uint64_t>(_words, 0) };
+		}
+
+		// Offer the greedy selection, compatible rides in ratio order, as the first incumbent.
+		void seed_greedy()
+		{
+			Node node = root();
+			for (size_t p = 0; p < _size; p++)
+			{
+				if (!is_banned(node.banned.data(), p) && _costs[p] <= node.capacity)
+				{
+					take(node, p);
+				}
+			}
+			offer(node.time, node.chosen);
+		}
+
+		// Expand the top of the tree breadth-first until there are at least count subtrees.
+		std::vector<Node> split(size_t count) const
+		{
+			std::vector<Node> frontier(1, root());
+			for (size_t depth = 0; frontier.size() < count && depth < 64; depth++)
+			{
+				std::vector<Node> next;
+				bool expanded = false;
+				for (Node& node : frontier)
+				{
+					size_t p = next_candidate(node.banned.data(), node.position, node.capacity);
+					if (p == _size)
+					{
+						next.push_back(node);
+						continue;
+					}
+					expanded = true;
+
+					Node include = node;
+					take(include, p);
+					include.position = p + 1;
+					next.push_back(include);
+
+					node.position = p + 1;
+					next.push_back(node);
+				}
+				frontier.swap(next);
+				if (!expanded)
+				{
+					break;
+				}
+			}
+			return frontier;
+		}
+
+		// Search one subtree depth-first.
+		void search(const Node& node)
+		{
+			Scratch scratch;
+			scratch.banned_stack.resize((_size + 1) * _words + node.banned.size());
+			std::copy(node.banned.begin(), node.banned.end(), scratch.banned_stack.begin());
+			scratch.chosen = node.chosen;
+			search(node.position, scratch.banned_stack.data(), node.capacity, node.time, scratch);
+		}
+
+	//
+	private:
+
+		// One step up the convex hull of a clique: dt more minutes for dc more dollars.
+		struct Segment
+		{
+			long dc;
+			double dt;
+		};
+
+		// Buffers owned by one worker.
+		struct Scratch
+		{
+			std::vector<uint64_t> banned_stack;
+			std::vector<size_t> chosen;
+			std::vector<Segment> segments, hull;
+		};
+
+		bool is_banned(const uint64_t* banned, size_t p) const
+		{
+			return (banned[p / 64] >> (p % 64)) & 1;
+		}
+
+		// First position at or after p that is compatible and fits, or _size.
+		size_t next_candidate(const uint64_t* banned, size_t p, long capacity) const
+		{
+			while (p < _size && (is_banned(banned, p) || _costs[p] > capacity))
+			{
+				p++;
+			}
+			return p;
+		}
+
+		// LP bound over the compatible rides from position p on.
+		double bound(size_t p, const uint64_t* banned, long capacity, double time) const
+		{
+			for (; p < _size; p++)
+			{
+				if (is_banned(banned, p))
+				{
+					continue;
+				}
+				if (_costs[p] > capacity)
+				{
+					return time + _times[p] * capacity / _costs[p];
+				}
+				capacity -= _costs[p];
+				time += _times[p];
+			}
+			return time;
+		}
+
+		// Tighter bound: at most one ride from each clique can be chosen, so bound the
+		// LP relaxation of that multiple-choice problem. Each clique contributes the
+		// steps of the upper convex hull of its (cost, time) points, and the steps of all
+		// cliques are filled greedily by decreasing time per dollar.
+		double clique_bound(size_t p, const uint64_t* banned, long capacity, double time, Scratch& scratch) const
+		{
+			std::vector<Segment>& segments = scratch.segments;
+			std::vector<Segment>& hull = scratch.hull;
+			segments.clear();
+
+			for (const std::vector<size_t>& clique : _cliques)
+			{
+				// hull points are kept as cumulative (cost, time) from the origin
+				hull.clear();
+				hull.push_back(Segment{ 0, 0 });
+				for (size_t q : clique)
+				{
+					if (q < p || is_banned(banned, q) || _costs[q] > capacity || _times[q] <= hull.back().dt)
+					{
+						continue;
+					}
+					Segment point{ _costs[q], _times[q] };
+					while (hull.size() >= 2)
+					{
+						const Segment& a = hull[hull.size() - 2];
+						const Segment& b = hull.back();
+						// drop b when it lies on or below the line from a to the new point
+						if ((b.dt - a.dt) * (point.dc - a.dc) <= (point.dt - a.dt) * (b.dc - a.dc))
+						{
+							hull.pop_back();
+						}
+						else
+						{
+							break;
+						}
+					}
+					hull.push_back(point);
+				}
+				for (size_t k = 1; k < hull.size(); k++)
+				{
+					segments.push_back(Segment{ hull[k].dc - hull[k - 1].dc, hull[k].dt - hull[k - 1].dt });
+				}
+			}
+
+			std::sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b)
+			{
+				return a.dt * b.dc > b.dt * a.dc;
+			});
+			for (const Segment& segment : segments)
+			{
+				if (segment.dc > capacity)
+				{
+					return time + segment.dt * capacity / segment.dc;
+				}
+				capacity -= segment.dc;
+				time += segment.dt;
+			}
+			return time;
+		}
+
+		void take(Node& node, size_t p) const
+		{
+			node.capacity -= _costs[p];
+			node.time += _times[p];
+			node.chosen.push_back(p);
+			for (size_t w = 0; w < _words; w++)
+			{
+				node.banned[w] |= _adjacency[p * _words + w];
+			}
+		}
+
+		void offer(double time, const std::vector<size_t>& chosen)
+		{
+			if (time > _incumbent.time())
+			{
+				std::vector<size_t> selection;
+				for (size_t p : chosen)
+				{
+					selection.push_back(_original[p]);
+				}
+				_incumbent.offer(time, selection);
+			}
+		}
+
+		// banned points at this level's bitset; the next level's bitset follows it.
+		void search(size_t p, uint64_t* banned, long capacity, double time, Scratch& scratch)
+		{
+			std::vector<size_t>& chosen = scratch.chosen;
+			offer(time, chosen);
+
+			while (true)
+			{
+				p = next_candidate(banned, p, capacity);
+				if (p == _size)
+				{
+					return;
+				}
+
+				// try the cheap bound first, then the clique bound;
+				// bounds are sums of doubles, so treat a gain below rounding as no gain
+				double incumbent = _incumbent.time();
+				double good_enough = incumbent + 1e-9 * std::max(1.0, incumbent);
+				if (bound(p, banned, capacity, time) <= good_enough
+					|| clique_bound(p, banned, capacity, time, scratch) <= good_enough)
+				{
+					return;
+				}
+
+				// include p
+				uint64_t* next_banned = banned + _words;
+				for (size_t w = 0; w < _words; w++)
+				{
+					next_banned[w] = banned[w] | _adjacency[p * _words + w];
+				}
+				chosen.push_back(p);
+				search(p + 1, next_banned, capacity - _costs[p], time + _times[p], scratch);
+				chosen.pop_back();
+
+				// exclude p, and carry on with the next candidate
+				p++;
+			}
+		}
+
+		SharedIncumbent& _incumbent;
+		long _total_cost;
+		size_t _size, _words;
+		std::vector<size_t> _original;
+		std::vector<int> _costs;
+		std::vector<double> _times;
+		std::vector<uint64_t> _adjacency;
+		std::vector<std::vector<size_t>> _cliques;
+};
+
+
+// Compute the optimal set of ride items within the total_cost budget such that
+// no two chosen rides conflict, by parallel branch-and-bound.
+// threads is the number of worker threads; 0 means one per hardware thread.
+// orderings, if given, supplies the ratio order of rides.
+// If report is not null, the serial split and the parallel search are added to it.
+inline std::unique_ptr<RideVector> conflict_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const ConflictGraph& conflicts,
+	size_t threads = 0,
+	const RideOrderings* orderings = nullptr,
+	ParallelReport* report = nullptr
+)
+{
+	assert(conflicts.size() == rides.size());
+
+	if (threads == 0)
+	{
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	SharedIncumbent incumbent;
+	std::unique_ptr<ConflictSearch> search;
+	std::vector<ConflictSearch::Node> subtrees;
+	{
+		ParallelPhase phase(report, "conflict split", 1);
+		ThreadCpuTimer split_cpu;
+		search.reset(new ConflictSearch(rides, total_cost, conflicts, incumbent, orderings));
+		search->seed_greedy();
+		subtrees = search->split(threads * 16);
+		phase.record_thread(0, split_cpu.elapsed());
+	}
+
+	// workers take subtrees in turn until none are left
+	{
+		ParallelPhase phase(report, "conflict search", threads);
+		std::atomic<size_t> next_subtree(0);
+		auto worker = [&](size_t t)
+		{
+			ThreadCpuTimer cpu;
+			for (size_t k; (k = next_subtree.fetch_add(1)) < subtrees.size(); )
+			{
+				search->search(subtrees[k]);
+			}
+			phase.record_thread(t, cpu.elapsed());
+		};
+
+		std::vector<std::thread> pool;
+		for (size_t t = 1; t < threads; t++)
+		{
+			pool.emplace_back(worker, t);
+		}
+		worker(0);
+		for (std::thread& thread : pool)
+		{
+			thread.join();
+		}
+	}
+
+	std::vector<size_t> selection = incumbent.selection();
+	std::sort(selection.begin(), selection.end());
+
+	std::unique_ptr<RideVector> result(new RideVector);
+	for (size_t i : selection)
+	{
+		(*result).push_back(rides[i]);
+	}
+	return result;
+}
@@ -0,0 +1,276 @@
+///////////////////////////////////////////////////////////////////////////////
+// counting.hh
+//
+// Count the selections of rides that fit within each budget, and how their
+// total times are distributed, without enumerating them.
+//
+// Counting uses the row recurrence of dynamic_max_time with (+) in place of
+// max: after each ride, the number of selections spending exactly j dollars
+// is the number without the ride plus the number spending j - cost without
+// it. A prefix sum over j then gives the selections within each budget. The
+// time distribution runs the same recurrence over a second dimension, the
+// total time rounded to a histogram bin.
+//
+// Exact counts are 128-bit and saturate at SELECTION_COUNT_MAX; with all of
+// ride.csv that happens between $200 and $500. The modular counts never
+// saturate and suit checks against other counts.
+//
+// How to use:
+//
+//    auto within = count_selections(*rides, 50);
+//    // within[50] selections cost at most $50 (about 8.45e10 in ride.csv)
+//    auto histogram = time_histogram(*rides, 50, 10.0, 100);
+//    // histogram.counts(50)[k] of them take between 10k and 10k + 10 minutes
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+#include "isa.hh"
+#include "maxtime.hh"
+#include "workspace.hh"
+
+
+// An exact count of selections, saturating at SELECTION_COUNT_MAX.
+typedef unsigned __int128 SelectionCount;
+
+const SelectionCount SELECTION_COUNT_MAX = ~SelectionCount(0);
+
+
+// a + b, or SELECTION_COUNT_MAX if that overflows.
+inline SelectionCount saturating_add(SelectionCount a, SelectionCount b)
+{
+	SelectionCount sum = a + b;
+	return sum < a ? SELECTION_COUNT_MAX : sum;
+}
+
+
+// One row of the counting table: next[j] = previous[j] + previous[j - cost], for
+// j = 0 .. total_cost, in 128-bit saturating arithmetic.
+MAXTIME_KERNEL
+inline void count_row_update
+(
+	const SelectionCount* previous,
+	SelectionCount* next,
+	int total_cost,
+	int cost
+)
+{
+	int j = std::min(cost, total_cost + 1);
+	std::copy(previous, previous + j, next);
+	for (; j <= total_cost; j++)
+	{
+		next[j] = saturating_add(previous[j], previous[j - cost]);
+	}
+}
+
+// Same as above modulo modulus; previous holds residues.
+MAXTIME_KERNEL
+inline void count_row_update_modulo
+(
+	const uint64_t* previous,
+	uint64_t* next,
+	int total_cost,
+	int cost,
+	uint64_t modulus
+)
+{
+	int j = std::min(cost, total_cost + 1);
+	std::copy(previous, previous + j, next);
+	for (; j <= total_cost; j++)
+	{
+		// both terms are below modulus < 2^63, so the sum does not wrap
+		uint64_t sum = previous[j] + previous[j - cost];
+		next[j] = sum >= modulus ? sum - modulus : sum;
+	}
+}
+
+
+// within[b] is the number of selections of rides costing at most b, for b = 0 .. total_cost,
+// counting the empty selection. Empty if total_cost is negative.
+inline std::vector<SelectionCount> count_selections
+(
+	const RideVector& rides,
+	int total_cost
+)
+{
+	std::vector<SelectionCount> within;
+	if (total_cost < 0)
+	{
+		return within;
+	}
+
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+
+	size_t width = size_t(total_cost) + 1;
+	SelectionCount* previous = workspace.borrow_zeroed<SelectionCount>(width);
+	SelectionCount* next = workspace.borrow<SelectionCount>(width);
+	previous[0] = 1;
+	for (auto& ride : rides)
+	{
+		count_row_update(previous, next, total_cost, ride->cost());
+		std::swap(previous, next);
+	}
+
+	within.resize(width);
+	within[0] = previous[0];
+	for (size_t j = 1; j < width; j++)
+	{
+		within[j] = saturating_add(within[j - 1], previous[j]);
+	}
+	return within;
+}
+
+
+// Same as count_selections, modulo modulus, which must be between 1 and 2^63.
+inline std::vector<uint64_t> count_selections_modulo
+(
+	const RideVector& rides,
+	int total_cost,
+	uint64_t modulus
+)
+{
+	assert(modulus >= 1 && modulus <= (uint64_t(1) << 63));
+
+	std::vector<uint64_t> within;
+	if (total_cost < 0)
+	{
+		return within;
+	}
+
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+
+	size_t width = size_t(total_cost) + 1;
+	uint64_t* previous = workspace.borrow_zeroed<uint64_t>(width);
+	uint64_t* next = workspace.borrow<uint64_t>(width);
+	previous[0] = 1 % modulus;
+	for (auto& ride : rides)
+	{
+		count_row_update_modulo(previous, next, total_cost, ride->cost(), modulus);
+		std::swap(previous, next);
+	}
+
+	within.resize(width);
+	within[0] = previous[0];
+	for (size_t j = 1; j < width; j++)
+	{
+		uint64_t sum = within[j - 1] + previous[j];
+		within[j] = sum >= modulus ? sum - modulus : sum;
+	}
+	return within;
+}
+
+
+// How the total times of the selections within each budget are distributed.
+// Each ride's time is rounded to the nearest whole number of bins before it is
+// added, so a selection of k rides may land up to k / 2 bins from its exact bin;
+// choose bin_width well above the time resolution when that matters.
+class TimeHistogram
+{
+	//
+	public:
+
+		//
+		TimeHistogram(int total_cost, double bin_width, size_t bins)
+			:
+			_bin_width(bin_width),
+			_bins(bins),
+			_within(total_cost < 0 ? 0 : (size_t(total_cost) + 1) * bins)
+		{
+		}
+
+		// Width of a bin, in minutes.
+		double bin_width() const { return _bin_width; }
+
+		// Number of bins; the last also holds every longer total.
+		size_t bins() const { return _bins; }
+
+		// Largest budget with a histogram.
+		int total_cost() const { return int(_within.size() / _bins) - 1; }
+
+		// counts(budget)[k] selections costing at most budget take k * bin_width minutes
+		// give or take half a bin per ride; budget must be at most total_cost().
+		const SelectionCount* counts(int budget) const
+		{
+			assert(budget >= 0 && budget <= total_cost());
+			return _within.data() + size_t(budget) * _bins;
+		}
+
+	//
+	private:
+
+		friend TimeHistogram time_histogram(const RideVector&, int, double, size_t);
+
+		double _bin_width;
+		size_t _bins;
+		std::vector<SelectionCount> _within;
+};
+
+
+// Histogram of the total times of the selections of rides within each budget up to
+// total_cost, in bins of bin_width minutes; see TimeHistogram. O(n * total_cost * bins).
+inline TimeHistogram time_histogram
+(
+	const RideVector& rides,
+	int total_cost,
+	double bin_width,
+	size_t bins
+)
+{
+	assert(bin_width > 0 && bins > 0);
+
+	TimeHistogram histogram(total_cost, bin_width, bins);
+	if (total_cost < 0)
+	{
+		return histogram;
+	}
+
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+
+	// row j holds the counts of selections spending exactly j dollars, by time bin
+	size_t width = size_t(total_cost) + 1, last = bins - 1;
+	SelectionCount* previous = workspace.borrow_zeroed<SelectionCount>(width * bins);
+	SelectionCount* next = workspace.borrow<SelectionCount>(width * bins);
+	previous[0] = 1;
+	for (auto& ride : rides)
+	{
+		int cost = ride->cost();
+		size_t shift = size_t(std::max(0.0, std::round(ride->time() / bin_width)));
+		std::copy(previous, previous + width * bins, next);
+		for (size_t j = cost; j < width; j++)
+		{
+			const SelectionCount* from = previous + (j - cost) * bins;
+			SelectionCount* to = next + j * bins;
+			for (size_t k = 0; k < bins; k++)
+			{
+				size_t bin = std::min(last, k + shift);
+				to[bin] = saturating_add(to[bin], from[k]);
+			}
+		}
+		std::swap(previous, next);
+	}
+
+	// within budget b: every exact spend up to b
+	SelectionCount* within = histogram._within.data();
+	for (size_t j = 0; j < width; j++)
+	{
+		for (size_t k = 0; k < bins; k++)
+		{
+			within[j * bins + k] = saturating_add(j == 0 ? 0 : within[(j - 1) * bins + k], previous[j * bins + k]);
+		}
+	}
+	return histogram;
+}
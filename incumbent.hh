@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////
+// incumbent.hh
+//
+// The best selection found so far, shared by the threads of a parallel search.
+//
+// Threads read the incumbent time lock-free to prune, and improve it with a
+// compare-and-swap; only a thread that wins the swap takes the lock to store
+// its selection.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+
+// Best total time found so far, and the ride indices that achieve it.
+class SharedIncumbent
+{
+	//
+	public:
+
+		//
+		explicit SharedIncumbent(double time = 0)
+			:
+			_time(time),
+			_stored_time(time)
+		{
+		}
+
+		SharedIncumbent(const SharedIncumbent&) = delete;
+		SharedIncumbent& operator=(const SharedIncumbent&) = delete;
+
+		// Best time so far; a search may prune anything that cannot beat it.
+		double time() const { return _time.load(std::memory_order_acquire); }
+
+		// Offer a selection with the given total time.
+		// Kept only if strictly better than the incumbent; returns whether it was kept.
+		bool offer(double time, const std::vector<size_t>& selection)
+		{
+			double current = _time.load(std::memory_order_acquire);
+			while (time > current)
+			{
+				if (_time.compare_exchange_weak(current, time, std::memory_order_acq_rel))
+				{
+					// A better offer may have raced past us between the swap and the lock;
+					// keep whichever selection has the greater time.
+					std::lock_guard<std::mutex> lock(_mutex);
+					if (time > _stored_time)
+					{
+						_stored_time = time;
+						_selection = selection;
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Ride indices of the best selection so far.
+		std::vector<size_t> selection() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _selection;
+		}
+
+	//
+	private:
+
+		std::atomic<double> _time;
+		mutable std::mutex _mutex;
+		double _stored_time;
+		std::vector<size_t> _selection;
+};
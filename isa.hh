@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////////
+// isa.hh
+//
+// Function multiversioning for the hot kernels.
+//
+// A function marked MAXTIME_KERNEL is compiled once per instruction set in
+// MAXTIME_KERNEL_TARGETS, and the dynamic loader picks the best version the
+// host supports the first time it is called (a GNU ifunc). One binary built
+// without -march therefore runs AVX-512 code on AVX-512 hosts, AVX2 code on
+// AVX2 hosts, and baseline x86-64 code elsewhere.
+//
+// Multiversioning needs GCC or Clang on x86-64 with glibc; elsewhere, or when
+// MAXTIME_NO_CLONES is defined, MAXTIME_KERNEL expands to nothing and each
+// kernel is compiled once for the target given on the command line.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__) && !defined(MAXTIME_NO_CLONES)
+#define MAXTIME_KERNEL_CLONES 1
+#define MAXTIME_KERNEL __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define MAXTIME_KERNEL_CLONES 0
+#define MAXTIME_KERNEL
+#endif
+
+
+// Name of the kernel version this host runs, for benchmark reports.
+inline const char* kernel_target()
+{
+#if MAXTIME_KERNEL_CLONES
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		return "avx512f";
+	}
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return "avx2";
+	}
+	return "default";
+#else
+	return "single target";
+#endif
+}
@@ -10,18 +10,28 @@
 #pragma once
 
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <iterator>
 #include <memory>
 #include <queue>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 
+#include "isa.hh"
+#include "parallel_report.hh"
+#include "workspace.hh"
+
+
 // One ride item available for purchase.
 class RideItem
 {
@@ -67,10 +77,64 @@ class RideItem
 typedef std::vector<std::shared_ptr<RideItem>> RideVector;
 
 
+// Mark each newline and each '^' field separator of data in the bit arrays
+// newlines and separators, which need room for size / 64 + 1 words.
+MAXTIME_KERNEL
+inline void scan_ride_bytes
+(
+	const char* data,
+	size_t size,
+	uint64_t* newlines,
+	uint64_t* separators
+)
+{
+	size_t whole = size / 64;
+	for (size_t w = 0; w < whole; w++)
+	{
+		const char* block = data + w * 64;
+		uint64_t line_bits = 0, field_bits = 0;
+		for (uint64_t b = 0; b < 64; b++)
+		{
+			line_bits |= uint64_t(block[b] == '\n') << b;
+			field_bits |= uint64_t(block[b] == '^') << b;
+		}
+		newlines[w] = line_bits;
+		separators[w] = field_bits;
+	}
+
+	uint64_t line_bits = 0, field_bits = 0;
+	for (size_t i = whole * 64; i < size; i++)
+	{
+		line_bits |= uint64_t(data[i] == '\n') << (i % 64);
+		field_bits |= uint64_t(data[i] == '^') << (i % 64);
+	}
+	newlines[whole] = line_bits;
+	separators[whole] = field_bits;
+}
+
+// Position of the first bit set in bits at or after from and before limit, or limit.
+inline size_t next_marked(const std::vector<uint64_t>& bits, size_t from, size_t limit)
+{
+	for (size_t w = from / 64; w * 64 < limit; w++)
+	{
+		uint64_t word = bits[w];
+		if (w == from / 64)
+		{
+			word &= ~uint64_t(0) << (from % 64);
+		}
+		if (word != 0)
+		{
+			return std::min(limit, w * 64 + __builtin_ctzll(word));
+		}
+	}
+	return limit;
+}
+
+
 // Load all the valid ride items from the CSV database
 // ride items that are missing fields, or have invalid values, are skipped.
 // Returns nullptr on I/O error.
-std::unique_ptr<RideVector> load_ride_database(const std::string& path)
+inline std::unique_ptr<RideVector> load_ride_database(const std::string& path)
 {
 	std::unique_ptr<RideVector> failure(nullptr);
 
@@ -83,9 +147,17 @@ std::unique_ptr<RideVector> load_ride_database(const std::string& path)
 
 	std::unique_ptr<RideVector> result(new RideVector);
 
+	// find every line and field boundary in one vectorized pass over the file
+	std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	std::vector<uint64_t> newlines(data.size() / 64 + 1), separators(data.size() / 64 + 1);
+	scan_ride_bytes(data.data(), data.size(), newlines.data(), separators.data());
+
+	// lines and fields split as std::getline would: no line after a final newline,
+	// and no empty field after a final separator
 	size_t line_number = 0;
-	for (std::string line; std::getline(f, line); )
+	for (size_t line_start = 0, line_end; line_start < data.size(); line_start = line_end + 1)
 	{
+		line_end = next_marked(newlines, line_start, data.size());
 		line_number++;
 
 		// First line is a header row
@@ -94,12 +166,12 @@ std::unique_ptr<RideVector> load_ride_database(const std::string& path)
 			continue;
 		}
 
+		std::string line(data, line_start, line_end - line_start);
 		std::vector<std::string> fields;
-		std::stringstream ss(line);
-
-		for (std::string field; std::getline(ss, field, '^'); )
+		for (size_t field_start = line_start, field_end; field_start < line_end; field_start = field_end + 1)
 		{
-			fields.push_back(field);
+			field_end = next_marked(separators, field_start, line_end);
+			fields.push_back(data.substr(field_start, field_end - field_start));
 		}
 
 		if (fields.size() != 3)
@@ -158,7 +230,7 @@ std::unique_ptr<RideVector> load_ride_database(const std::string& path)
 // Convenience function to compute the total cost and time in a RideVector.
 // Provide the RideVector as the first argument
 // The next two arguments will return the cost and time back to the caller.
-void sum_ride_vector
+inline void sum_ride_vector
 (
 	const RideVector& rides,
 	int& total_cost,
@@ -176,7 +248,7 @@ void sum_ride_vector
 
 // Convenience function to print out each RideItem in a RideVector,
 // followed by the total kilocalories and protein in it.
-void print_ride_vector(const RideVector& rides)
+inline void print_ride_vector(const RideVector& rides)
 {
 	std::cout << "*** ride Vector ***" << std::endl;
 
@@ -213,7 +285,7 @@ void print_ride_vector(const RideVector& rides)
 // For sanity, will refuse to print a cache that is too large.
 // Hint: When running this program, you can redirect stdout to a file,
 //	which may be easier to view and inspect than a terminal
-void print_2d_cache(const std::vector<std::vector<double>>& cache)
+inline void print_2d_cache(const std::vector<std::vector<double>>& cache)
 {
 	std::cout << "*** 2D Cache ***" << std::endl;
 
@@ -238,6 +310,43 @@ void print_2d_cache(const std::vector<std::vector<double>>& cache)
 	}
 }
 
+// Set bit i of matches (n / 64 + 1 words) when times[i] is positive and within
+// [min_time, max_time], the filter_ride_vector criteria.
+MAXTIME_KERNEL
+inline void mark_matching_times
+(
+	const double* times,
+	size_t n,
+	double min_time,
+	double max_time,
+	uint64_t* matches
+)
+{
+	size_t whole = n / 64;
+	for (size_t w = 0; w < whole; w++)
+	{
+		const double* block = times + w * 64;
+		uint64_t flags[64];
+		for (size_t b = 0; b < 64; b++)
+		{
+			flags[b] = (block[b] > 0) & (block[b] >= min_time) & (block[b] <= max_time);
+		}
+		uint64_t bits = 0;
+		for (uint64_t b = 0; b < 64; b++)
+		{
+			bits |= flags[b] << b;
+		}
+		matches[w] = bits;
+	}
+
+	uint64_t bits = 0;
+	for (size_t i = whole * 64; i < n; i++)
+	{
+		bits |= uint64_t((times[i] > 0) & (times[i] >= min_time) & (times[i] <= max_time)) << (i % 64);
+	}
+	matches[whole] = bits;
+}
+
 // Filter the vector source, i.e. create and return a new RideVector containing the subset of 
 // the ride items in source that match given criteria.
 // This is intended to:
@@ -248,7 +357,9 @@ void print_2d_cache(const std::vector<std::vector<double>>& cache)
 //	(i.e., each included ride item's time must be between min_time and max_time (inclusive).
 //
 // In addition, the the vector includes only the first total_size ride items that match these criteria.
-std::unique_ptr<RideVector> filter_ride_vector
+// The times are tested a block at a time by mark_matching_times, and the scan stops at the
+// block that completes the selection.
+inline std::unique_ptr<RideVector> filter_ride_vector
 (
 	const RideVector& source,
 	double min_time,
@@ -256,15 +367,334 @@ std::unique_ptr<RideVector> filter_ride_vector
 	int total_size
 )
 {
-std::unique_ptr<RideVector> sortedVector(new RideVector);
-for(size_t i = 0; i < source.size(); i++)
+	std::unique_ptr<RideVector> matches(new RideVector);
+	if (total_size <= 0)
+	{
+		return matches;
+	}
+	size_t keep = total_size;
+
+	const size_t BLOCK = 256;
+	double times[BLOCK];
+	uint64_t matched[BLOCK / 64 + 1];
+	for (size_t block = 0; block < source.size() && (*matches).size() < keep; block += BLOCK)
+	{
+		size_t count = std::min(BLOCK, source.size() - block);
+		for (size_t k = 0; k < count; k++)
+		{
+			times[k] = source[block + k]->time();
+		}
+		mark_matching_times(times, count, min_time, max_time, matched);
+
+		for (size_t w = 0; w * 64 < count; w++)
+		{
+			for (uint64_t bits = matched[w]; bits != 0 && (*matches).size() < keep; bits &= bits - 1)
+			{
+				(*matches).push_back(source[block + w * 64 + __builtin_ctzll(bits)]);
+			}
+		}
+	}
+	return matches;
+}
+
+// How filter_ride_vector chooses total_size rides among those that match.
+enum FilterSelection
+{
+	// The first matches in source order, as above.
+	FILTER_FIRST_MATCHES,
+
+	// The matches with the longest time, longest first; ties keep source order.
+	FILTER_LONGEST
+};
+
+// Same as above, choosing which matches to keep with selection.
+// FILTER_LONGEST scans source in parallel chunks, using threads worker threads
+// (0 means one per hardware thread, if source is large enough to be worth it). Each chunk keeps its own total_size longest
+// matches with nth_element, and the survivors are merged the same way, so the
+// cost is O(n + total_size log total_size) rather than a sort of the whole catalog.
+// If report is not null, the scan and merge phases are added to it.
+inline std::unique_ptr<RideVector> filter_ride_vector
+(
+	const RideVector& source,
+	double min_time,
+	double max_time,
+	int total_size,
+	FilterSelection selection,
+	size_t threads = 0,
+	ParallelReport* report = nullptr
+)
+{
+	if (selection == FILTER_FIRST_MATCHES)
+	{
+		return filter_ride_vector(source, min_time, max_time, total_size);
+	}
+
+	std::unique_ptr<RideVector> longest(new RideVector);
+	if (total_size <= 0)
+	{
+		return longest;
+	}
+	size_t keep = total_size;
+
+	auto longer = [&](size_t a, size_t b)
+	{
+		return source[a]->time() > source[b]->time() || (source[a]->time() == source[b]->time() && a < b);
+	};
+
+	// by default, no point starting a thread for fewer rides than this
+	const size_t MIN_CHUNK = 16384;
+	if (threads == 0)
+	{
+		threads = std::min<size_t>(std::thread::hardware_concurrency(), source.size() / MIN_CHUNK);
+	}
+	threads = std::max<size_t>(1, std::min(threads, source.size()));
+	size_t chunk = (source.size() + threads - 1) / threads;
+
+	std::vector<std::vector<size_t>> survivors(threads);
+	{
+		ParallelPhase phase(report, "filter scan", threads);
+		auto scan = [&](size_t t)
+		{
+			ThreadCpuTimer cpu;
+			std::vector<size_t>& kept = survivors[t];
+			size_t end = std::min(source.size(), (t + 1) * chunk);
+
+			// gather the times a block at a time and test them in one vectorized pass
+			const size_t BLOCK = 4096;
+			std::vector<double> times(BLOCK);
+			std::vector<uint64_t> matched(BLOCK / 64 + 1);
+			for (size_t block = t * chunk; block < end; block += BLOCK)
+			{
+				size_t count = std::min(BLOCK, end - block);
+				for (size_t k = 0; k < count; k++)
+				{
+					times[k] = source[block + k]->time();
+				}
+				mark_matching_times(times.data(), count, min_time, max_time, matched.data());
+
+				for (size_t w = 0; w * 64 < count; w++)
+				{
+					for (uint64_t bits = matched[w]; bits != 0; bits &= bits - 1)
+					{
+						kept.push_back(block + w * 64 + __builtin_ctzll(bits));
+
+						// trim back to keep whenever the buffer doubles
+						if (kept.size() >= 2 * keep)
+						{
+							std::nth_element(kept.begin(), kept.begin() + keep, kept.end(), longer);
+							kept.resize(keep);
+						}
+					}
+				}
+			}
+			phase.record_thread(t, cpu.elapsed());
+		};
+
+		std::vector<std::thread> pool;
+		for (size_t t = 1; t < threads; t++)
+		{
+			pool.emplace_back(scan, t);
+		}
+		scan(0);
+		for (std::thread& thread : pool)
+		{
+			thread.join();
+		}
+	}
+
+	{
+		ParallelPhase phase(report, "filter merge", 1);
+		ThreadCpuTimer merge_cpu;
+		std::vector<size_t> merged;
+		for (std::vector<size_t>& kept : survivors)
+		{
+			merged.insert(merged.end(), kept.begin(), kept.end());
+		}
+		if (merged.size() > keep)
+		{
+			std::nth_element(merged.begin(), merged.begin() + keep, merged.end(), longer);
+			merged.resize(keep);
+		}
+		std::sort(merged.begin(), merged.end(), longer);
+
+		(*longest).reserve(merged.size());
+		for (size_t i : merged)
+		{
+			(*longest).push_back(source[i]);
+		}
+		phase.record_thread(0, merge_cpu.elapsed());
+	}
+	return longest;
+}
+
+// Gather the cost and time of each ride into flat arrays borrowed from workspace,
+// so the solver kernels below never chase shared_ptrs.
+inline void gather_ride_columns
+(
+	const RideVector& rides,
+	SolverWorkspace& workspace,
+	int*& costs,
+	double*& times
+)
+{
+	costs = workspace.borrow<int>(rides.size());
+	times = workspace.borrow<double>(rides.size());
+	for (size_t i = 0; i < rides.size(); i++)
+	{
+		costs[i] = rides[i]->cost();
+		times[i] = rides[i]->time();
+	}
+}
+
+// One row of the dynamic programming table: next[j] is the best time within budget j
+// using the rides so far, given previous[j] without the current ride.
+// Sets bit j of taken when taking the current ride is strictly better.
+//
+// COST is the ride's cost as a compile-time constant, so the offset between the
+// two loads is fixed and each 64-budget word of the row unrolls into straight
+// vector code; COST < 0 reads the cost from the cost argument instead.
+template <int COST>
+MAXTIME_KERNEL
+void dynamic_row_kernel
+(
+	const double* previous,
+	double* next,
+	uint64_t* taken,
+	int total_cost,
+	int cost,
+	double time
+)
 {
-	if((*source[i]).time() > 0 && ((*source[i]).time() >= min_time && (*source[i]).time() <= max_time) && (*sortedVector).size() < total_size)
+	const int shift = COST >= 0 ? COST : cost;
+	const int width = total_cost + 1;
+
+	// budgets below the cost cannot take the ride; none if total_cost is negative
+	int j = std::max(std::min(shift, width), 0);
+	std::copy(previous, previous + j, next);
+
+	// a partial first word, whole words, then a partial last word
+	while (j < width)
 	{
-		(*sortedVector).push_back(source[i]);
+		int end = std::min(width, (j / 64 + 1) * 64);
+		uint64_t mask = 0;
+		if (j % 64 == 0 && end - j == 64)
+		{
+			// compare into 64-bit flags, the width of a double so the loop
+			// vectorizes, then fold the flags into the mask
+			const double* skip = previous + j;
+			const double* take = previous + (j - shift);
+			double* out = next + j;
+			uint64_t better[64];
+			for (int b = 0; b < 64; b++)
+			{
+				double with = take[b] + time;
+				better[b] = with > skip[b] ? 1 : 0;
+				out[b] = with > skip[b] ? with : skip[b];
+			}
+			for (uint64_t b = 0; b < 64; b++)
+			{
+				mask |= better[b] << b;
+			}
+		}
+		else
+		{
+			for (int b = j; b < end; b++)
+			{
+				bool better = previous[b - shift] + time > previous[b];
+				next[b] = better ? previous[b - shift] + time : previous[b];
+				mask |= uint64_t(better) << (b % 64);
+			}
+		}
+		taken[j / 64] |= mask;
+		j = end;
 	}
 }
-	return sortedVector;
+
+// Costs from 1 to below this have a dynamic_row_kernel specialized for their value;
+// ride.csv prices run from 6 to 105.
+const int DYNAMIC_KERNEL_COSTS = 128;
+
+typedef void (*DynamicRowKernel)(const double*, double*, uint64_t*, int, int, double);
+
+template <int... COSTS>
+const DynamicRowKernel* dynamic_row_kernel_table(std::integer_sequence<int, COSTS...>)
+{
+	static const DynamicRowKernel table[] = { &dynamic_row_kernel<COSTS + 1>... };
+	return table;
+}
+
+// The row kernel specialized for a ride of the given cost, or the generic one.
+// maxtime_bench times these against the generic kernel, which dynamic_row_update
+// uses: on the development hosts the specialized kernels ran at 0.76x to 1.08x its
+// speed, no clear win for 127 more copies of the kernel.
+inline DynamicRowKernel dynamic_row_kernel_for(int cost)
+{
+	static const DynamicRowKernel* table = dynamic_row_kernel_table(std::make_integer_sequence<int, DYNAMIC_KERNEL_COSTS - 1>());
+	return cost >= 1 && cost < DYNAMIC_KERNEL_COSTS ? table[cost - 1] : &dynamic_row_kernel<-1>;
+}
+
+// One row of the dynamic programming table, by the generic row kernel.
+inline void dynamic_row_update
+(
+	const double* previous,
+	double* next,
+	uint64_t* taken,
+	int total_cost,
+	int cost,
+	double time
+)
+{
+	dynamic_row_kernel<-1>(previous, next, taken, total_cost, cost, time);
+}
+
+// Dynamic algorithm over n rides given as flat cost and time arrays.
+// Writes the indices of the chosen rides to selected, from the last ride to the first,
+// and returns how many were chosen. selected must have room for n indices.
+// All scratch space is borrowed from workspace.
+inline size_t dynamic_select
+(
+	const int* costs,
+	const double* times,
+	size_t n,
+	int total_cost,
+	size_t* selected,
+	SolverWorkspace& workspace
+)
+{
+	if (total_cost < 0)
+	{
+		return 0;
+	}
+
+	SolverWorkspace::Frame frame(workspace);
+
+	// two rolling rows instead of the whole table, plus one bit per table cell
+	// recording whether the ride was taken
+	size_t width = size_t(total_cost) + 1;
+	size_t words = (width + 63) / 64;
+	double* previous = workspace.borrow_zeroed<double>(width);
+	double* next = workspace.borrow<double>(width);
+	uint64_t* taken = workspace.borrow_zeroed<uint64_t>(n * words);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		dynamic_row_update(previous, next, taken + i * words, total_cost, costs[i], times[i]);
+		std::swap(previous, next);
+	}
+
+	// traceback the decision bits from the last ride to the first
+	size_t count = 0;
+	int cost = total_cost;
+	for (size_t i = n; i > 0; i--)
+	{
+		if ((taken[(i - 1) * words + cost / 64] >> (cost % 64)) & 1)
+		{
+			selected[count++] = i - 1;
+			cost -= costs[i - 1];
+		}
+	}
+
+	return count;
 }
 
 // Compute the optimal set of ride items with a dynamic algorithm.
@@ -272,62 +702,147 @@ for(size_t i = 0; i < source.size(); i++)
 // choose the selection of rides whose time is greatest.
 // Repeat until no more ride items can be chosen, either because we've run out of ride items,
 // or run out of dollars.
-std::unique_ptr<RideVector> dynamic_max_time
+// Scratch space is borrowed from workspace and returned before this function returns.
+inline std::unique_ptr<RideVector> dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	SolverWorkspace& workspace
+)
+{
+	std::unique_ptr<RideVector> best1(new RideVector);
+	SolverWorkspace::Frame frame(workspace);
+
+	int* costs;
+	double* times;
+	gather_ride_columns(rides, workspace, costs, times);
+	size_t* selected = workspace.borrow<size_t>(rides.size());
+
+	size_t count = dynamic_select(costs, times, rides.size(), total_cost, selected, workspace);
+
+	(*best1).reserve(count);
+	for (size_t k = 0; k < count; k++)
+	{
+		(*best1).push_back(rides[selected[k]]);
+	}
+
+	return best1;
+}
+
+// Same as above, using the calling thread's workspace.
+inline std::unique_ptr<RideVector> dynamic_max_time
 (
 	const RideVector& rides,
 	int total_cost 
 )
 {
-	std::unique_ptr<RideVector> best1(new RideVector); 
-	int n = rides.size();
+	return dynamic_max_time(rides, total_cost, thread_workspace());
+}
 
-	// creates the cache 2D vector and set all values to zero
-    std::vector<std::vector<double>> cache;
-    for (int i = 0; i <= n; i++) 
+// Dynamic algorithm over n rides, choosing at most max_rides of them.
+// Keeps max_rides + 1 rolling layers of the budget row, one per ride count, and one
+// decision bit per (ride, count, budget). Otherwise the same contract as dynamic_select.
+// When max_rides >= n the limit cannot bind, so this is exactly dynamic_select.
+inline size_t dynamic_select_limited
+(
+	const int* costs,
+	const double* times,
+	size_t n,
+	int total_cost,
+	size_t max_rides,
+	size_t* selected,
+	SolverWorkspace& workspace
+)
+{
+	if (max_rides >= n)
 	{
-        std::vector<double> zero;
-        for (int j = 0; j <= total_cost; j++) 
-		{
-            zero.push_back(0);
-        }
-        cache.push_back(zero);
-    }
+		return dynamic_select(costs, times, n, total_cost, selected, workspace);
+	}
+	if (total_cost < 0 || max_rides == 0)
+	{
+		return 0;
+	}
 
-	// fills the 2D vector with the max cost/time value
-    for (long unsigned int i = 1; i < cache.size(); i++) 
+	SolverWorkspace::Frame frame(workspace);
+
+	// best[k * width + j] is the best time with at most k rides within budget j
+	size_t width = size_t(total_cost) + 1;
+	size_t words = (width + 63) / 64;
+	double* best = workspace.borrow_zeroed<double>((max_rides + 1) * width);
+	uint64_t* taken = workspace.borrow_zeroed<uint64_t>(n * max_rides * words);
+
+	for (size_t i = 0; i < n; i++)
 	{
-		std::shared_ptr<RideItem> current = rides[i - 1];
-        for (int j = 0; j <= total_cost; j++) 
+		int cost = costs[i];
+		double time = times[i];
+
+		// update the layers from the most rides down, so layer k - 1 still
+		// holds the value from before this ride
+		for (size_t k = max_rides; k >= 1; k--)
 		{
-            double value = 0;
-            if (j >= current->cost()) 
+			const double* fewer = best + (k - 1) * width;
+			double* layer = best + k * width;
+			uint64_t* bits = taken + (i * max_rides + (k - 1)) * words;
+			for (int j = cost; j <= total_cost; j++)
 			{
-                value = (cache[i - 1][j - current->cost()]) + current->time();
-            }
-            cache[i][j] = std::max(value, cache[i - 1][j]);
-        }
-    }
+				double value = fewer[j - cost] + time;
+				if (value > layer[j])
+				{
+					layer[j] = value;
+					bits[j / 64] |= uint64_t(1) << (j % 64);
+				}
+			}
+		}
+	}
 
-	// traceback the entire 2D vector and adds different values into new RideVector
+	// traceback from the full budget and ride count
+	size_t count = 0;
+	size_t k = max_rides;
 	int cost = total_cost;
-	for (int i = rides.size(); i >= 0; i--) 
-	{	
-		if (i == 0) 
+	for (size_t i = n; i > 0 && k > 0; i--)
+	{
+		const uint64_t* bits = taken + ((i - 1) * max_rides + (k - 1)) * words;
+		if ((bits[cost / 64] >> (cost % 64)) & 1)
 		{
-		break;
+			selected[count++] = i - 1;
+			cost -= costs[i - 1];
+			k--;
 		}
+	}
 
-		if(cache[i][cost] != cache[i - 1][cost]) 
-		{
-			(*best1).push_back(rides[i - 1]); 
-			cost -= rides[i - 1]->cost();
-		}
+	return count;
+}
+
+// Compute the optimal set of at most max_rides ride items with a dynamic algorithm.
+// Same as dynamic_max_time when max_rides is at least the number of rides.
+inline std::unique_ptr<RideVector> dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	size_t max_rides
+)
+{
+	std::unique_ptr<RideVector> best1(new RideVector);
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+
+	int* costs;
+	double* times;
+	gather_ride_columns(rides, workspace, costs, times);
+	size_t* selected = workspace.borrow<size_t>(rides.size());
+
+	size_t count = dynamic_select_limited(costs, times, rides.size(), total_cost, max_rides, selected, workspace);
+
+	(*best1).reserve(count);
+	for (size_t k = 0; k < count; k++)
+	{
+		(*best1).push_back(rides[selected[k]]);
 	}
 
 	return best1;
 }
 
-std::vector<std::vector<RideItem>> getTimeSubsets(std::vector<RideItem> source)
+inline std::vector<std::vector<RideItem>> getTimeSubsets(std::vector<RideItem> source)
 {
     std::vector<std::vector<RideItem>> subset, subTemp;
 
@@ -343,23 +858,188 @@ std::vector<std::vector<RideItem>> getTimeSubsets(std::vector<RideItem> source)
     return subset;
 }
 
+// Exhaustive search over n rides given as flat cost and time arrays.
+// Writes the indices of the chosen rides to selected in increasing order,
+// and returns how many were chosen. selected must have room for n indices.
+// n must be less than 64.
+MAXTIME_KERNEL
+inline size_t exhaustive_select
+(
+	const int* costs,
+	const double* times,
+	size_t n,
+	double total_cost,
+	size_t* selected
+)
+{
+	assert(n < 64);
+
+	uint64_t best_bits = 0;
+	double bestTotalTime = 0;
+
+	uint64_t subsets = uint64_t(1) << n;
+	for (uint64_t bits = 0; bits < subsets; bits++)
+	{
+		// calculate total cost and total time of the candidate without building it
+		int candidateTotalCost = 0;
+		double candidateTotalTime = 0;
+		for (size_t j = 0; j < n; j++)
+		{
+			if (((bits >> j) & 1) == 1)
+			{
+				candidateTotalCost += costs[j];
+				candidateTotalTime += times[j];
+			}
+		}
+
+		// move candidate to best if within budget and has greater total time than current best
+		if (candidateTotalCost <= total_cost)
+		{
+			if (best_bits == 0 || candidateTotalTime > bestTotalTime)
+			{
+				best_bits = bits;
+				bestTotalTime = candidateTotalTime;
+			}
+		}
+	}
+
+	size_t count = 0;
+	for (size_t j = 0; j < n; j++)
+	{
+		if (((best_bits >> j) & 1) == 1)
+		{
+			selected[count++] = j;
+		}
+	}
+	return count;
+}
+
+// Exhaustive search over n rides, choosing at most max_rides of them.
+// Only subsets of exactly k rides, for k = 0 .. max_rides, are visited, each size in turn
+// enumerated with Gosper's hack rather than filtering all 2^n subsets.
+// When max_rides >= n this is exactly exhaustive_select.
+MAXTIME_KERNEL
+inline size_t exhaustive_select_limited
+(
+	const int* costs,
+	const double* times,
+	size_t n,
+	double total_cost,
+	size_t max_rides,
+	size_t* selected
+)
+{
+	assert(n < 64);
+
+	if (max_rides >= n)
+	{
+		return exhaustive_select(costs, times, n, total_cost, selected);
+	}
+
+	uint64_t best_bits = 0;
+	double bestTotalTime = 0;
+
+	uint64_t subsets = uint64_t(1) << n;
+	for (size_t k = 1; k <= max_rides; k++)
+	{
+		// smallest subset of k rides, then each next subset of k rides in increasing order
+		for (uint64_t bits = (uint64_t(1) << k) - 1; bits < subsets; )
+		{
+			int candidateTotalCost = 0;
+			double candidateTotalTime = 0;
+			for (uint64_t rest = bits; rest != 0; rest &= rest - 1)
+			{
+				size_t j = __builtin_ctzll(rest);
+				candidateTotalCost += costs[j];
+				candidateTotalTime += times[j];
+			}
+
+			if (candidateTotalCost <= total_cost)
+			{
+				if (best_bits == 0 || candidateTotalTime > bestTotalTime)
+				{
+					best_bits = bits;
+					bestTotalTime = candidateTotalTime;
+				}
+			}
+
+			// Gosper's hack
+			uint64_t lowest = bits & (~bits + 1);
+			uint64_t ripple = bits + lowest;
+			bits = (((ripple ^ bits) >> 2) / lowest) | ripple;
+		}
+	}
+
+	size_t count = 0;
+	for (size_t j = 0; j < n; j++)
+	{
+		if (((best_bits >> j) & 1) == 1)
+		{
+			selected[count++] = j;
+		}
+	}
+	return count;
+}
+
 // Compute the optimal set of ride items with a exhaustive search algorithm.
 // Specifically, among all subsets of ride items,
 // return the subset whose dollars cost fits within the total_cost budget,
 // and whose total time is greatest.
 // To avoid overflow, the size of the ride items vector must be less than 64.
-std::unique_ptr<RideVector> exhaustive_max_time
+// Scratch space is borrowed from workspace and returned before this function returns.
+inline std::unique_ptr<RideVector> exhaustive_max_time
+(
+	const RideVector& rides,
+	double total_cost,
+	SolverWorkspace& workspace
+)
+{
+	std::unique_ptr<RideVector> best1(new RideVector);
+
+	// ride items vector must be less than 64 to avoid overflow
+	if (rides.size() >= 64)
+	{
+		exit(1);	// if ride size is greater than 64, exit program
+	}
+
+	SolverWorkspace::Frame frame(workspace);
+
+	int* costs;
+	double* times;
+	gather_ride_columns(rides, workspace, costs, times);
+	size_t* selected = workspace.borrow<size_t>(rides.size());
+
+	size_t count = exhaustive_select(costs, times, rides.size(), total_cost, selected);
+
+	(*best1).reserve(count);
+	for (size_t k = 0; k < count; k++)
+	{
+		(*best1).push_back(rides[selected[k]]);
+	}
+	return best1;
+}
+
+// Same as above, using the calling thread's workspace.
+inline std::unique_ptr<RideVector> exhaustive_max_time
 (
 	const RideVector& rides,
 	double total_cost
 )
+{
+	return exhaustive_max_time(rides, total_cost, thread_workspace());
+}
+
+// Compute the optimal set of at most max_rides ride items with a exhaustive search algorithm.
+// Same as exhaustive_max_time when max_rides is at least the number of rides.
+// The size of the ride items vector must be less than 64.
+inline std::unique_ptr<RideVector> exhaustive_max_time
+(
+	const RideVector& rides,
+	double total_cost,
+	size_t max_rides
+)
 {
 	std::unique_ptr<RideVector> best1(new RideVector);
-	size_t n = rides.size();
-	int candidateTotalCost = 0;
-	double candidateTotalTime = 0;
-	int bestTotalCost = 0;
-	double bestTotalTime = 0;
 
 	// ride items vector must be less than 64 to avoid overflow
 	if (rides.size() >= 64)
@@ -367,30 +1047,139 @@ std::unique_ptr<RideVector> exhaustive_max_time
 		exit(1);	// if ride size is greater than 64, exit program
 	}
 
-	for (uint64_t bits = 0; bits < pow(2, n); bits++)
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+
+	int* costs;
+	double* times;
+	gather_ride_columns(rides, workspace, costs, times);
+	size_t* selected = workspace.borrow<size_t>(rides.size());
+
+	size_t count = exhaustive_select_limited(costs, times, rides.size(), total_cost, max_rides, selected);
+
+	(*best1).reserve(count);
+	for (size_t k = 0; k < count; k++)
 	{
-		std::unique_ptr<RideVector> candidate1(new RideVector);
+		(*best1).push_back(rides[selected[k]]);
+	}
+	return best1;
+}
+
+// Best total time within every budget 0 .. total_cost over n rides, in one pass over
+// all 2^n subsets: best[b] for each b, which must have room for total_cost + 1 values.
+// The low min(n, 12) rides are walked in Gray-code order, each subset one ride away from
+// the last, so their totals are updated with one add or subtract; their costs and times
+// are tabled once and reused under every subset of the remaining rides, whose totals are
+// summed afresh so rounding cannot drift across the whole walk. Each subset's time is
+// scattered into a best-at-exactly-this-cost array, and a prefix max turns that into the
+// best within each budget. n must be less than 64.
+inline void exhaustive_frontier
+(
+	const int* costs,
+	const double* times,
+	size_t n,
+	int total_cost,
+	double* best
+)
+{
+	assert(n < 64);
+	if (total_cost < 0)
+	{
+		return;
+	}
+	std::fill(best, best + total_cost + 1, 0.0);
+
+	const size_t LOW_RIDES = 12;
+	size_t low = std::min(n, LOW_RIDES);
+	size_t low_subsets = size_t(1) << low;
+	std::vector<int> low_costs(low_subsets);
+	std::vector<double> low_times(low_subsets);
+	uint64_t gray = 0;
+	for (size_t step = 1; step < low_subsets; step++)
+	{
+		size_t ride = __builtin_ctzll(step);
+		gray ^= uint64_t(1) << ride;
+		bool added = (gray >> ride) & 1;
+		low_costs[step] = low_costs[step - 1] + (added ? costs[ride] : -costs[ride]);
+		low_times[step] = low_times[step - 1] + (added ? times[ride] : -times[ride]);
+	}
 
-		for (uint64_t j = 0; j < n; j++)
+	uint64_t high_subsets = uint64_t(1) << (n - low);
+	for (uint64_t high = 0; high < high_subsets; high++)
+	{
+		int high_cost = 0;
+		double high_time = 0;
+		for (size_t j = 0; j < n - low; j++)
 		{
-			if (((bits >> j) & 1) == 1)
+			if ((high >> j) & 1)
 			{
-				(*candidate1).push_back(rides[j]);
+				high_cost += costs[low + j];
+				high_time += times[low + j];
 			}
 		}
-		
-		// calculate total cost and total time of candidate and best
-		sum_ride_vector(*candidate1, candidateTotalCost, candidateTotalTime);
-		sum_ride_vector(*best1, bestTotalCost, bestTotalTime);
+		if (high_cost > total_cost)
+		{
+			continue;
+		}
 
-		// move candidate to best if within budget and has greater total time than current best
-		if (candidateTotalCost <= total_cost)
+		int room = total_cost - high_cost;
+		double* at = best + high_cost;
+		for (size_t step = 0; step < low_subsets; step++)
 		{
-			if ((*best1).empty() || candidateTotalTime > bestTotalTime)
+			if (low_costs[step] <= room)
 			{
-				*best1 = *candidate1;
+				at[low_costs[step]] = std::max(at[low_costs[step]], high_time + low_times[step]);
 			}
 		}
 	}
-	return best1;
-}
\ No newline at end of file
+
+	for (int b = 1; b <= total_cost; b++)
+	{
+		best[b] = std::max(best[b], best[b - 1]);
+	}
+}
+
+// Best total time of rides within every budget 0 .. total_cost, by exhaustive_frontier.
+// Empty if total_cost is negative; rides must be fewer than 64.
+inline std::vector<double> exhaustive_time_frontier
+(
+	const RideVector& rides,
+	int total_cost
+)
+{
+	std::vector<double> frontier(std::max(0, total_cost + 1));
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+	int* costs;
+	double* times;
+	gather_ride_columns(rides, workspace, costs, times);
+	exhaustive_frontier(costs, times, rides.size(), total_cost, frontier.data());
+	return frontier;
+}
+
+// Best total time of rides within every budget 0 .. total_cost: the last row of the
+// dynamic programming table. Empty if total_cost is negative.
+inline std::vector<double> dynamic_time_frontier
+(
+	const RideVector& rides,
+	int total_cost
+)
+{
+	if (total_cost < 0)
+	{
+		return std::vector<double>();
+	}
+
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+	size_t width = size_t(total_cost) + 1;
+	double* previous = workspace.borrow_zeroed<double>(width);
+	double* next = workspace.borrow<double>(width);
+	uint64_t* unused_taken = workspace.borrow<uint64_t>((width + 63) / 64);
+	for (auto& ride : rides)
+	{
+		dynamic_row_update(previous, next, unused_taken, total_cost, ride->cost(), ride->time());
+		std::swap(previous, next);
+	}
+	return std::vector<double>(previous, previous + width);
+}
@@ -0,0 +1,566 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxtime_bench.cc
+//
+// Timings for the solver kernels in maxtime.hh.
+//
+// Build and run with "make bench"; the build is optimized, unlike the tests.
+//
+//    maxtime_bench                      kernel timings
+//    maxtime_bench --roofline [--json]  kernels placed on this host's roofline,
+//                                       as CSV or JSON; see roofline.hh
+//    maxtime_bench --parallel [--threads N]
+//                                       speedup, efficiency and waiting per phase
+//                                       of each parallel solver; see parallel_report.hh
+//    maxtime_bench --record FILE [--samples N]
+//                                       append N timings of each solver to a
+//                                       history; see bench_history.hh
+//    maxtime_bench --compare FILE [BASELINE CANDIDATE] [--alpha A] [--min-ratio R]
+//                                       flag solvers significantly slower in
+//                                       run CANDIDATE than in run BASELINE (by
+//                                       default the last two runs); exits 1 if any.
+//                                       Shared or virtual hosts drift between runs
+//                                       and may need a larger R than the 1.05 default.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+#include "batch.hh"
+#include "bench_history.hh"
+#include "branch_bound.hh"
+#include "conflict.hh"
+#include "counting.hh"
+#include "maxtime.hh"
+#include "monte_carlo.hh"
+#include "parallel_report.hh"
+#include "ride_index.hh"
+#include "roofline.hh"
+#include "timer.hh"
+
+
+// Best of a few runs of fn, in seconds.
+template <typename Function>
+double best_time(Function fn)
+{
+	double best = 0;
+	for (int run = 0; run < 3; run++)
+	{
+		Timer timer;
+		fn();
+		double elapsed = timer.elapsed();
+		if (run == 0 || elapsed < best)
+		{
+			best = elapsed;
+		}
+	}
+	return best;
+}
+
+
+// Fill the dynamic programming table of all rides with one kernel choice, and
+// return the best of a few runs in seconds. The last row and the decision bits
+// of the last run are left in last_row and taken.
+template <typename PickKernel>
+double time_dynamic_rows
+(
+	const std::vector<int>& costs,
+	const std::vector<double>& times,
+	int total_cost,
+	PickKernel pick,
+	std::vector<double>& last_row,
+	std::vector<uint64_t>& taken
+)
+{
+	size_t width = size_t(total_cost) + 1, words = (width + 63) / 64;
+	std::vector<double> previous(width), next(width);
+	taken.assign(costs.size() * words, 0);
+
+	double best = 0;
+	for (int run = 0; run < 3; run++)
+	{
+		std::fill(previous.begin(), previous.end(), 0);
+		std::fill(taken.begin(), taken.end(), 0);
+		Timer timer;
+		for (size_t i = 0; i < costs.size(); i++)
+		{
+			pick(costs[i])(previous.data(), next.data(), taken.data() + i * words, total_cost, costs[i], times[i]);
+			std::swap(previous, next);
+		}
+		double elapsed = timer.elapsed();
+		if (run == 0 || elapsed < best)
+		{
+			best = elapsed;
+		}
+	}
+	last_row = previous;
+	return best;
+}
+
+
+// Time the solver kernels on inputs of several sizes and count what each moves and computes;
+// see roofline.hh. The counts follow the loops in maxtime.hh and counting.hh.
+std::vector<KernelSample> roofline_samples(const RideVector& all_rides)
+{
+	std::vector<KernelSample> samples;
+
+	// loader scan: read each byte, two compares; two bitmaps of size / 8 bytes written
+	std::ifstream file("ride.csv", std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	for (size_t copies : { 1, 256 })
+	{
+		std::string text;
+		for (size_t c = 0; c < copies; c++)
+		{
+			text += data;
+		}
+		std::vector<uint64_t> newlines(text.size() / 64 + 1), separators(text.size() / 64 + 1);
+		double seconds = best_time([&]() { scan_ride_bytes(text.data(), text.size(), newlines.data(), separators.data()); });
+		double size = text.size();
+		samples.push_back({ "scan_ride_bytes", std::to_string(text.size()) + " bytes", false,
+			seconds, size * 1.25, size * 2, size * 1.25 });
+	}
+
+	// filter scan: read a time, three compares; one bit written
+	std::vector<double> times;
+	for (auto& ride : all_rides)
+	{
+		times.push_back(ride->time());
+	}
+	for (size_t n : { times.size(), size_t(1) << 23 })
+	{
+		std::vector<double> many(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			many[i] = times[i % times.size()];
+		}
+		std::vector<uint64_t> matches(n / 64 + 1);
+		double seconds = best_time([&]() { mark_matching_times(many.data(), n, 100, 500, matches.data()); });
+		samples.push_back({ "mark_matching_times", std::to_string(n) + " times", true,
+			seconds, n * 8.125, n * 3.0, n * 8.125 });
+	}
+
+	// exhaustive: per subset, n bit tests and on average n / 2 integer and n / 2 double adds
+	// over the 12-byte cost and time of each ride, then a budget and a time compare
+	auto small_rides = filter_ride_vector(all_rides, 1, 2500, 20);
+	size_t n = small_rides->size();
+	std::vector<int> small_costs;
+	std::vector<double> small_times;
+	for (auto& ride : *small_rides)
+	{
+		small_costs.push_back(ride->cost());
+		small_times.push_back(ride->time());
+	}
+	std::vector<size_t> selected(n);
+	double exhaustive = best_time([&]() { exhaustive_select(small_costs.data(), small_times.data(), n, 500, selected.data()); });
+	double subsets = double(uint64_t(1) << n);
+	samples.push_back({ "exhaustive_select", std::to_string(n) + " rides", false,
+		exhaustive, subsets * 12 * n, subsets * (2 * n + 2), 12.0 * n });
+
+	// dynamic rows: per cell, read two doubles and write one, add and compare, one decision bit;
+	// the two rows are the working set, the decision bits stream out
+	std::vector<int> costs;
+	for (auto& ride : all_rides)
+	{
+		costs.push_back(ride->cost());
+	}
+	for (int total_cost : { 500, 20000, 200000 })
+	{
+		size_t rides = total_cost > 20000 ? 512 : costs.size();
+		std::vector<int> some_costs(costs.begin(), costs.begin() + rides);
+		std::vector<double> some_times(times.begin(), times.begin() + rides);
+		std::vector<double> row;
+		std::vector<uint64_t> taken;
+		double cells = double(rides) * (total_cost + 1);
+		std::string parameters = std::to_string(rides) + " rides budget " + std::to_string(total_cost);
+
+		double generic = time_dynamic_rows(some_costs, some_times, total_cost,
+			[](int) { return &dynamic_row_kernel<-1>; }, row, taken);
+		samples.push_back({ "dynamic_row_kernel generic", parameters, true,
+			generic, cells * 24.125, cells * 2, 16.0 * (total_cost + 1) });
+
+		double specialized = time_dynamic_rows(some_costs, some_times, total_cost, dynamic_row_kernel_for, row, taken);
+		samples.push_back({ "dynamic_row_kernel per-cost", parameters, true,
+			specialized, cells * 24.125, cells * 2, 16.0 * (total_cost + 1) });
+
+		// counting rows: read two residues and write one, add, compare and subtract
+		size_t width = size_t(total_cost) + 1;
+		std::vector<uint64_t> previous(width), next(width);
+		double counting = best_time([&]()
+		{
+			std::fill(previous.begin(), previous.end(), 0);
+			previous[0] = 1;
+			for (size_t i = 0; i < rides; i++)
+			{
+				count_row_update_modulo(previous.data(), next.data(), total_cost, some_costs[i], 1000000007);
+				std::swap(previous, next);
+			}
+		});
+		samples.push_back({ "count_row_update_modulo", parameters, false,
+			counting, cells * 24, cells * 3, 16.0 * width });
+	}
+
+	return samples;
+}
+
+
+// Measure the roofs, place each kernel under them, and write CSV or JSON to stdout.
+int run_roofline(const RideVector& all_rides, bool json)
+{
+	RooflinePeaks peaks = measure_roofline_peaks();
+	std::vector<RooflinePoint> points;
+	for (const KernelSample& sample : roofline_samples(all_rides))
+	{
+		points.push_back(place_on_roofline(sample, peaks));
+	}
+	if (json)
+	{
+		write_roofline_json(std::cout, peaks, points);
+	}
+	else
+	{
+		write_roofline_csv(std::cout, peaks, points);
+	}
+	return 0;
+}
+
+
+// Run each parallel solver on threads threads and print its phases.
+int run_parallel(const RideVector& all_rides, size_t threads)
+{
+	auto print = [](const std::string& title, const ParallelReport& report)
+	{
+		std::cout << title << std::endl;
+		report.write(std::cout);
+		std::cout << std::endl;
+	};
+
+	ParallelReport filter;
+	for (int run = 0; run < 20; run++)
+	{
+		filter_ride_vector(all_rides, 100, 500, 100, FILTER_LONGEST, threads, &filter);
+	}
+	print("filter_ride_vector longest 100, 20 runs", filter);
+
+	ParallelReport sort;
+	std::vector<uint64_t> keys;
+	for (auto& ride : all_rides)
+	{
+		keys.push_back(ordered_key(ride->time()));
+	}
+	std::vector<size_t> order;
+	radix_sort_indices(keys, order, threads, &sort);
+	print("radix_sort_indices by time", sort);
+
+	auto rides = filter_ride_vector(all_rides, 1, 2500, 2000);
+	ParallelReport branch_bound;
+	branch_bound_max_time(*rides, 2000, threads, 4096, nullptr, &branch_bound);
+	print("branch_bound_max_time, " + std::to_string(rides->size()) + " rides, budget 2000", branch_bound);
+
+	auto few_rides = filter_ride_vector(all_rides, 1, 2500, 60);
+	ConflictGraph conflicts(few_rides->size());
+	for (size_t i = 0; i + 1 < few_rides->size(); i += 2)
+	{
+		conflicts.add_conflict(i, i + 1);
+	}
+	ParallelReport conflict;
+	conflict_max_time(*few_rides, 300, conflicts, threads, nullptr, &conflict);
+	print("conflict_max_time, " + std::to_string(few_rides->size()) + " rides in pairs, budget 300", conflict);
+
+	std::ostringstream queries, answers;
+	for (int q = 0; q < 512; q++)
+	{
+		queries << 1 + q % 7 << " 2500 " << 100 + q % 5 * 100 << ' ' << 100 + q % 11 * 40 << " dynamic\n";
+	}
+	ParallelReport batch;
+	std::istringstream in(queries.str());
+	QueryBatchSolver(all_rides, 0, threads, &batch).run_text(in, answers);
+	print("QueryBatchSolver, 512 dynamic queries", batch);
+
+	std::vector<double> mean_waits(all_rides.size(), 15.0);
+	ParallelReport monte_carlo;
+	MonteCarloEvaluator evaluator(all_rides, mean_waits, 2000, 42, threads, { 5, 25, 50, 75, 95 }, &monte_carlo);
+	std::vector<size_t> plan = evaluator.sample_average_plan(500);
+	evaluator.evaluate({ plan });
+	print("MonteCarloEvaluator, 2000 scenarios, sample average plan and evaluate", monte_carlo);
+	return 0;
+}
+
+
+// Time each solver samples times and append the timings to the history at path as one run.
+int run_record(const std::string& path, int samples)
+{
+	BenchmarkRecord run;
+	run.run = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+	run.revision = git_revision();
+	run.host = host_fingerprint();
+
+	std::unique_ptr<RideVector> all_rides = load_ride_database("ride.csv");
+	if (!all_rides)
+	{
+		return 1;
+	}
+	auto small_rides = filter_ride_vector(*all_rides, 1, 2500, 20);
+
+	std::vector<BenchmarkRecord> records;
+	auto record = [&](const std::string& benchmark, auto fn)
+	{
+		BenchmarkRecord timings = run;
+		timings.benchmark = benchmark;
+		fn();
+		for (int s = 0; s < samples; s++)
+		{
+			Timer timer;
+			fn();
+			timings.samples.push_back(timer.elapsed());
+		}
+		records.push_back(timings);
+	};
+	record("load_ride_database", [&]() { load_ride_database("ride.csv"); });
+	record("filter_ride_vector", [&]() { filter_ride_vector(*all_rides, 100, 500, 100, FILTER_LONGEST, 1); });
+	record("dynamic_max_time", [&]() { dynamic_max_time(*all_rides, 500); });
+	record("exhaustive_max_time", [&]() { exhaustive_max_time(*small_rides, 500); });
+
+	if (!append_benchmark_history(path, records))
+	{
+		std::cerr << "cannot append to " << path << std::endl;
+		return 1;
+	}
+	std::cout << "recorded run " << run.run << " at revision " << run.revision << " in " << path << std::endl;
+	return 0;
+}
+
+
+// Compare two runs of the history at path; exits 1 if any solver got slower.
+int run_compare(const std::string& path, std::string baseline, std::string candidate, double alpha, double min_ratio)
+{
+	std::vector<BenchmarkRecord> history = load_benchmark_history(path);
+	std::vector<std::string> runs = benchmark_runs(history);
+	if (baseline.empty())
+	{
+		if (runs.size() < 2)
+		{
+			std::cerr << path << " has fewer than two runs" << std::endl;
+			return 2;
+		}
+		baseline = runs[runs.size() - 2];
+		candidate = runs.back();
+	}
+
+	std::string baseline_host, candidate_host;
+	for (const BenchmarkRecord& record : history)
+	{
+		if (record.run == baseline)
+		{
+			baseline_host = record.host;
+		}
+		else if (record.run == candidate)
+		{
+			candidate_host = record.host;
+		}
+	}
+	if (baseline_host.empty() || candidate_host.empty())
+	{
+		std::cerr << "no run " << (baseline_host.empty() ? baseline : candidate) << " in " << path << std::endl;
+		return 2;
+	}
+	if (baseline_host != candidate_host)
+	{
+		std::cout << "warning: runs were recorded on different hosts" << std::endl;
+	}
+
+	bool slower = false;
+	std::cout << "baseline " << baseline << ", candidate " << candidate << std::endl;
+	for (const BenchmarkComparison& comparison : compare_benchmark_runs(history, baseline, candidate, alpha, min_ratio))
+	{
+		std::cout << std::left << std::setw(22) << comparison.benchmark << std::right
+			<< std::setw(12) << comparison.baseline_median * 1e3 << " ms"
+			<< std::setw(12) << comparison.candidate_median * 1e3 << " ms"
+			<< std::setw(9) << comparison.ratio << "x"
+			<< "  p=" << comparison.p_value
+			<< (comparison.slower ? "  SLOWER" : "") << std::endl;
+		slower = slower || comparison.slower;
+	}
+	return slower ? 1 : 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+	bool roofline = false, json = false;
+	std::string record_path, compare_path, baseline, candidate;
+	int samples = 10;
+	double alpha = 0.01, min_ratio = 1.05;
+	bool parallel = false;
+	size_t threads = 0;
+	for (int a = 1; a < argc; a++)
+	{
+		if (std::strcmp(argv[a], "--roofline") == 0)
+		{
+			roofline = true;
+		}
+		else if (std::strcmp(argv[a], "--json") == 0)
+		{
+			json = true;
+		}
+		else if (std::strcmp(argv[a], "--record") == 0 && a + 1 < argc)
+		{
+			record_path = argv[++a];
+		}
+		else if (std::strcmp(argv[a], "--samples") == 0 && a + 1 < argc && std::atoi(argv[a + 1]) > 0)
+		{
+			samples = std::atoi(argv[++a]);
+		}
+		else if (std::strcmp(argv[a], "--parallel") == 0)
+		{
+			parallel = true;
+		}
+		else if (std::strcmp(argv[a], "--threads") == 0 && a + 1 < argc)
+		{
+			threads = std::strtoul(argv[++a], nullptr, 10);
+		}
+		else if (std::strcmp(argv[a], "--alpha") == 0 && a + 1 < argc)
+		{
+			alpha = std::atof(argv[++a]);
+		}
+		else if (std::strcmp(argv[a], "--min-ratio") == 0 && a + 1 < argc)
+		{
+			min_ratio = std::atof(argv[++a]);
+		}
+		else if (std::strcmp(argv[a], "--compare") == 0 && a + 1 < argc)
+		{
+			compare_path = argv[++a];
+			if (a + 2 < argc && argv[a + 1][0] != '-')
+			{
+				baseline = argv[++a];
+				candidate = argv[++a];
+			}
+		}
+		else
+		{
+			std::cerr << "usage: maxtime_bench [--roofline [--json]] [--parallel [--threads N]] [--record FILE [--samples N]]"
+				" [--compare FILE [BASELINE CANDIDATE] [--alpha A] [--min-ratio R]]" << std::endl;
+			return 2;
+		}
+	}
+
+	if (roofline)
+	{
+		auto catalog = load_ride_database("ride.csv");
+		return catalog ? run_roofline(*catalog, json) : 1;
+	}
+	if (parallel)
+	{
+		auto catalog = load_ride_database("ride.csv");
+		if (threads == 0)
+		{
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		return catalog ? run_parallel(*catalog, threads) : 1;
+	}
+	if (!record_path.empty())
+	{
+		return run_record(record_path, samples);
+	}
+	if (!compare_path.empty())
+	{
+		return run_compare(compare_path, baseline, candidate, alpha, min_ratio);
+	}
+
+	std::cout << "kernel target: " << kernel_target() << std::endl;
+
+	std::unique_ptr<RideVector> all_rides;
+	double load = best_time([&]() { all_rides = load_ride_database("ride.csv"); });
+	if (!all_rides)
+	{
+		return 1;
+	}
+	std::cout << "load_ride_database: " << load * 1e3 << " ms" << std::endl;
+
+	double filter = best_time([&]() { filter_ride_vector(*all_rides, 100, 500, 100, FILTER_LONGEST, 1); });
+	std::cout << "filter_ride_vector longest 100: " << filter * 1e3 << " ms" << std::endl;
+
+	{
+		Timer startup;
+		BackgroundRideIndexes indexes(*all_rides);
+		indexes.filter_longest(100, 500, 100);
+		double first = startup.elapsed();
+		indexes.wait();
+		double indexed = best_time([&]() { indexes.filter_longest(100, 500, 100); });
+		std::cout << "background indexes: first filter " << first * 1e3 << " ms, all ready after "
+			<< startup.elapsed() * 1e3 << " ms, indexed filter " << indexed * 1e3 << " ms" << std::endl;
+	}
+
+	{
+		std::vector<uint32_t> counters(1 << 16), zeros(1 << 16), out(4 << 16);
+		std::iota(counters.begin(), counters.end(), 0);
+		double philox = best_time([&]()
+		{
+			philox4x32_10(counters.data(), zeros.data(), 1, 0, 7, 9, counters.size(),
+				out.data(), out.data() + counters.size(), out.data() + 2 * counters.size(), out.data() + 3 * counters.size());
+		});
+		std::cout << "philox4x32_10: " << 4 * counters.size() / philox / 1e6 << " M words/s" << std::endl;
+
+		std::vector<double> mean_waits(all_rides->size(), 15.0);
+		MonteCarloEvaluator evaluator(*all_rides, mean_waits, 1000, 42);
+		std::vector<size_t> plan;
+		double saa = best_time([&]() { plan = evaluator.sample_average_plan(500); });
+		double evaluate = best_time([&]() { evaluator.evaluate({ plan }); });
+		std::cout << "monte carlo, 1000 scenarios: sample average plan " << saa * 1e3 << " ms, evaluate "
+			<< plan.size() << " rides " << evaluate * 1e3 << " ms" << std::endl;
+	}
+
+	auto small_rides = filter_ride_vector(*all_rides, 1, 2500, 20);
+	double exhaustive = best_time([&]() { exhaustive_max_time(*small_rides, 500); });
+	std::cout << "exhaustive_max_time, " << small_rides->size() << " rides: " << exhaustive * 1e3 << " ms" << std::endl;
+
+	double frontier = best_time([&]() { exhaustive_time_frontier(*small_rides, 500); });
+	std::cout << "exhaustive_time_frontier, " << small_rides->size() << " rides, budgets 0..500: " << frontier * 1e3
+		<< " ms (501 exhaustive_max_time runs: about " << 501 * exhaustive << " s)" << std::endl;
+
+	std::vector<int> costs;
+	std::vector<double> times;
+	for (auto& ride : *all_rides)
+	{
+		costs.push_back(ride->cost());
+		times.push_back(ride->time());
+	}
+
+	std::cout << "dynamic row kernels, " << costs.size() << " rides" << std::endl;
+	for (int total_cost : { 500, 5000, 20000 })
+	{
+		std::vector<double> generic_row, specialized_row;
+		std::vector<uint64_t> generic_taken, specialized_taken;
+		double generic = time_dynamic_rows(costs, times, total_cost,
+			[](int) { return &dynamic_row_kernel<-1>; }, generic_row, generic_taken);
+		double specialized = time_dynamic_rows(costs, times, total_cost,
+			dynamic_row_kernel_for, specialized_row, specialized_taken);
+
+		if (generic_row != specialized_row || generic_taken != specialized_taken)
+		{
+			std::cout << "kernels disagree at budget " << total_cost << std::endl;
+			return 1;
+		}
+
+		double cells = double(costs.size()) * (total_cost + 1);
+		std::cout << "  budget " << total_cost
+			<< ": generic " << generic * 1e3 << " ms (" << cells / generic / 1e9 << " Gcell/s)"
+			<< ", per-cost " << specialized * 1e3 << " ms (" << cells / specialized / 1e9 << " Gcell/s)"
+			<< ", speedup " << generic / specialized << "x" << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxtime_c.cc
+//
+// Implementation of the C entry points in maxtime_c.h.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <new>
+
+
+#include "maxtime.hh"
+#include "maxtime_c.h"
+#include "workspace.hh"
+
+
+static_assert(sizeof(int32_t) == sizeof(int), "the solver kernels read costs as int");
+
+
+namespace
+{
+	// Check the arguments shared by the solve entry points.
+	int check_arguments(const int32_t* cost, const double* time, size_t n, size_t* selected, size_t capacity, size_t* count, double* total_time)
+	{
+		if (count == nullptr || total_time == nullptr || (n > 0 && (cost == nullptr || time == nullptr))
+			|| (capacity > 0 && selected == nullptr))
+		{
+			return MAXTIME_INVALID_ARGUMENT;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			if (cost[i] <= 0)
+			{
+				return MAXTIME_INVALID_ARGUMENT;
+			}
+		}
+		return MAXTIME_OK;
+	}
+
+	// Copy the chosen indices to the caller in increasing order and total their time.
+	int report(const size_t* chosen, size_t chosen_count, const double* time, size_t* selected, size_t capacity, size_t* count, double* total_time)
+	{
+		*count = chosen_count;
+		*total_time = 0;
+		for (size_t k = 0; k < chosen_count; k++)
+		{
+			*total_time += time[chosen[k]];
+		}
+		if (chosen_count > capacity)
+		{
+			return MAXTIME_BUFFER_TOO_SMALL;
+		}
+		std::copy(chosen, chosen + chosen_count, selected);
+		std::sort(selected, selected + chosen_count);
+		return MAXTIME_OK;
+	}
+}
+
+
+extern "C" uint32_t maxtime_abi_version(void)
+{
+	return MAXTIME_ABI_VERSION;
+}
+
+
+extern "C" int maxtime_reserve(size_t n, int32_t budget)
+{
+	if (budget < 0)
+	{
+		return MAXTIME_OK;
+	}
+
+	// what dynamic_select borrows: two rows, the decision bits, and the chosen indices
+	auto round_up = [](size_t bytes) { return (bytes + SolverWorkspace::ALIGNMENT - 1) / SolverWorkspace::ALIGNMENT * SolverWorkspace::ALIGNMENT; };
+	size_t width = size_t(budget) + 1, words = (width + 63) / 64;
+	size_t bytes = 2 * round_up(width * sizeof(double)) + round_up(n * words * sizeof(uint64_t)) + round_up(n * sizeof(size_t));
+	try
+	{
+		thread_workspace().reserve(bytes);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return MAXTIME_OUT_OF_MEMORY;
+	}
+	return MAXTIME_OK;
+}
+
+
+extern "C" int maxtime_dynamic
+(
+	const int32_t* cost,
+	const double* time,
+	size_t n,
+	int32_t budget,
+	size_t* selected,
+	size_t capacity,
+	size_t* count,
+	double* total_time
+)
+{
+	int status = check_arguments(cost, time, n, selected, capacity, count, total_time);
+	if (status != MAXTIME_OK)
+	{
+		return status;
+	}
+
+	try
+	{
+		SolverWorkspace& workspace = thread_workspace();
+		SolverWorkspace::Frame frame(workspace);
+		size_t* chosen = workspace.borrow<size_t>(n);
+		size_t chosen_count = dynamic_select(cost, time, n, budget, chosen, workspace);
+		return report(chosen, chosen_count, time, selected, capacity, count, total_time);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return MAXTIME_OUT_OF_MEMORY;
+	}
+}
+
+
+extern "C" int maxtime_exhaustive
+(
+	const int32_t* cost,
+	const double* time,
+	size_t n,
+	int32_t budget,
+	size_t* selected,
+	size_t capacity,
+	size_t* count,
+	double* total_time
+)
+{
+	int status = check_arguments(cost, time, n, selected, capacity, count, total_time);
+	if (status != MAXTIME_OK)
+	{
+		return status;
+	}
+	if (n >= 64)
+	{
+		return MAXTIME_TOO_MANY_RIDES;
+	}
+
+	size_t chosen[64];
+	size_t chosen_count = exhaustive_select(cost, time, n, budget, chosen);
+	return report(chosen, chosen_count, time, selected, capacity, count, total_time);
+}
@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxtime_c.h
+//
+// C entry points to the ride solvers, for callers that keep ride costs and
+// times in their own arrays.
+//
+// The solvers read the caller's arrays in place and write the chosen ride
+// indices to a caller-provided buffer, so no RideVector is built. Scratch
+// space comes from a per-thread SolverWorkspace; once a thread has solved a
+// query of a given size (or called maxtime_reserve), later queries up to that
+// size make no heap allocation.
+//
+// How to use:
+//
+//    if (maxtime_abi_version() != MAXTIME_ABI_VERSION) { ... }
+//    size_t chosen[N], count;
+//    double total_time;
+//    int status = maxtime_dynamic(costs, times, N, 500, chosen, N, &count, &total_time);
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef MAXTIME_C_H
+#define MAXTIME_C_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Version of the functions and types below. Bumped whenever a signature or
+// the meaning of an argument changes; compare with maxtime_abi_version() to
+// make sure the library loaded at run time matches this header.
+#define MAXTIME_ABI_VERSION 1
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Results of the entry points below.
+typedef enum
+{
+	MAXTIME_OK = 0,
+
+	// A required pointer is null, or a cost is not positive.
+	MAXTIME_INVALID_ARGUMENT = 1,
+
+	// The output buffer cannot hold every chosen index; *count holds the number needed.
+	MAXTIME_BUFFER_TOO_SMALL = 2,
+
+	// More rides than the engine supports (exhaustive search takes fewer than 64).
+	MAXTIME_TOO_MANY_RIDES = 3,
+
+	// Scratch space could not be allocated.
+	MAXTIME_OUT_OF_MEMORY = 4
+} maxtime_status;
+
+
+// MAXTIME_ABI_VERSION of the library.
+uint32_t maxtime_abi_version(void);
+
+// Grow the calling thread's scratch space for dynamic queries of up to n rides
+// and the given budget, so that even the first such query does not allocate.
+int maxtime_reserve(size_t n, int32_t budget);
+
+// Choose the rides among cost[0 .. n - 1] and time[0 .. n - 1] whose total time is
+// greatest within budget, as dynamic_max_time does. The chosen indices are written
+// to selected in increasing order, their number to *count, and their total time to
+// *total_time. selected has room for capacity indices; n always suffices.
+int maxtime_dynamic
+(
+	const int32_t* cost,
+	const double* time,
+	size_t n,
+	int32_t budget,
+	size_t* selected,
+	size_t capacity,
+	size_t* count,
+	double* total_time
+);
+
+// Same as maxtime_dynamic, by exhaustive search as exhaustive_max_time does.
+// n must be less than 64.
+int maxtime_exhaustive
+(
+	const int32_t* cost,
+	const double* time,
+	size_t n,
+	int32_t budget,
+	size_t* selected,
+	size_t capacity,
+	size_t* count,
+	double* total_time
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
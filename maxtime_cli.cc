@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxtime_cli.cc
+//
+// The maxtime command-line tool: load a ride catalog once, then answer
+// queries read from standard input. See batch.hh for the query and answer
+// formats.
+//
+// How to use:
+//
+//    maxtime [--catalog ride.csv] [--binary] [--cache N] [--threads N] [--report] < queries
+//
+// --report writes the time spent in each phase of the batches, and how busy
+// the threads were, to standard error at the end; see parallel_report.hh.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+
+#include "batch.hh"
+#include "maxtime.hh"
+#include "parallel_report.hh"
+
+
+int main(int argc, char* argv[])
+{
+	std::string catalog_path = "ride.csv";
+	bool binary = false, report = false;
+	size_t cache_capacity = 4096, threads = 0;
+
+	for (int a = 1; a < argc; a++)
+	{
+		std::string flag = argv[a];
+		if (flag == "--binary")
+		{
+			binary = true;
+		}
+		else if (flag == "--report")
+		{
+			report = true;
+		}
+		else if (flag == "--catalog" && a + 1 < argc)
+		{
+			catalog_path = argv[++a];
+		}
+		else if (flag == "--cache" && a + 1 < argc)
+		{
+			cache_capacity = std::strtoul(argv[++a], nullptr, 10);
+		}
+		else if (flag == "--threads" && a + 1 < argc)
+		{
+			threads = std::strtoul(argv[++a], nullptr, 10);
+		}
+		else
+		{
+			std::cerr << "usage: maxtime [--catalog ride.csv] [--binary] [--cache N] [--threads N] [--report] < queries" << std::endl;
+			return 2;
+		}
+	}
+
+	auto catalog = load_ride_database(catalog_path);
+	if (!catalog)
+	{
+		return 1;
+	}
+
+	// answers are written a batch at a time; keep stdout off stdio and unflushed in between
+	std::ios::sync_with_stdio(false);
+	std::cin.tie(nullptr);
+
+	ParallelReport phases;
+	QueryBatchSolver solver(*catalog, cache_capacity, threads, report ? &phases : nullptr);
+	if (binary)
+	{
+		solver.run_binary(std::cin, std::cout);
+	}
+	else
+	{
+		solver.run_text(std::cin, std::cout);
+	}
+	std::cout.flush();
+	if (report)
+	{
+		phases.write(std::cerr);
+	}
+	return 0;
+}
@@ -6,11 +6,37 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <set>
 #include <sstream>
 
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#include "batch.hh"
+#include "bench_history.hh"
+#include "bounds.hh"
+#include "branch_bound.hh"
+#include "catalog.hh"
+#include "changelog.hh"
+#include "co_optimal.hh"
+#include "conflict.hh"
+#include "counting.hh"
 #include "maxtime.hh"
+#include "maxtime_c.h"
+#include "monte_carlo.hh"
+#include "orderings.hh"
+#include "reachable.hh"
+#include "reduction.hh"
+#include "roofline.hh"
+#include "scenario.hh"
+#include "ride_index.hh"
 #include "rubrictest.hh"
 
 
@@ -206,5 +232,1292 @@ int main()
 		}
 	);
 	
+	//
+	rubric.criterion(
+		"SolverWorkspace reuse", 2,
+		[&]()
+		{
+			SolverWorkspace workspace;
+			auto small_rides = filter_ride_vector(*filtered_rides, 1, 2000, 12);
+			
+			auto warm_dynamic = dynamic_max_time(*filtered_rides, 500, workspace);
+			auto warm_exhaustive = exhaustive_max_time(*small_rides, 2000, workspace);
+			size_t allocations = workspace.allocations();
+			TEST_GE("arena grew to high water", workspace.capacity(), workspace.high_water());
+			
+			for (int i = 0; i < 3; i++)
+			{
+				auto soln = dynamic_max_time(*filtered_rides, 500, workspace);
+				TEST_EQUAL("same dynamic answer", warm_dynamic->size(), soln->size());
+				auto exhaustive = exhaustive_max_time(*small_rides, 2000, workspace);
+				TEST_EQUAL("same exhaustive answer", warm_exhaustive->size(), exhaustive->size());
+			}
+			TEST_EQUAL("steady state does not allocate", allocations, workspace.allocations());
+			
+			auto soln = dynamic_max_time(*filtered_rides, 500);
+			TEST_EQUAL("thread workspace gives the same answer", warm_dynamic->size(), soln->size());
+			for (size_t i = 0; i < soln->size(); i++)
+			{
+				TEST_EQUAL("thread workspace gives the same answer", (*warm_dynamic)[i], (*soln)[i]);
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"greedy and LP bounds", 2,
+		[&]()
+		{
+			TEST_EQUAL("trivial LP bound", 25, lp_upper_bound(trivial_rides, 14));
+			TEST_EQUAL("trivial LP bound leaves out rides over budget", 5, lp_upper_bound(trivial_rides, 6));
+			
+			auto greedy = greedy_max_time(trivial_rides, 10);
+			TEST_EQUAL("best single ride beats the prefix", 1, greedy->size());
+			TEST_EQUAL("best single ride beats the prefix", "test Ferris Wheel", (*greedy)[0]->description());
+			
+			// a ride over budget with the best ratio must not end the greedy prefix
+			RideVector oversized;
+			oversized.push_back(std::shared_ptr<RideItem>(new RideItem("test Drop Tower", 100.0, 1000.0)));
+			for (int i = 0; i < 10; i++)
+			{
+				oversized.push_back(std::shared_ptr<RideItem>(new RideItem("test Carousel", 1.0, 1.0)));
+			}
+			int oversized_cost;
+			double oversized_time;
+			sum_ride_vector(*greedy_max_time(oversized, 10), oversized_cost, oversized_time);
+			TEST_EQUAL("greedy skips rides over budget", 10, oversized_time);
+			TEST_EQUAL("frontier lower skips rides over budget", 10, TimeFrontier(oversized).lower(10));
+			TEST_EQUAL("frontier lower skips rides over budget", 5, TimeFrontier(oversized).lower(5));
+			TEST_EQUAL("frontier lower above the oversized ride", 1009, TimeFrontier(oversized).lower(109));
+			
+			TimeFrontier frontier(*filtered_rides);
+			for (int budget : { 0, 7, 500, 5000 })
+			{
+				auto exact = dynamic_max_time(*filtered_rides, budget);
+				int exact_cost;
+				double exact_time;
+				sum_ride_vector(*exact, exact_cost, exact_time);
+				
+				double upper = lp_upper_bound(*filtered_rides, budget);
+				auto approximate = greedy_max_time(*filtered_rides, budget);
+				int greedy_cost;
+				double greedy_time;
+				sum_ride_vector(*approximate, greedy_cost, greedy_time);
+				
+				TEST_LE("greedy within budget", greedy_cost, budget);
+				TEST_GE("LP bound is an upper bound", upper + 1e-6, exact_time);
+				TEST_LE("greedy is a lower bound", greedy_time, exact_time + 1e-6);
+				TEST_GE("greedy is a 1/2-approximation", 2 * greedy_time + 1e-6, exact_time);
+				
+				TEST_LT("frontier upper matches LP bound", std::fabs(frontier.upper(budget) - upper), 1e-6);
+				TEST_LT("frontier lower matches greedy", std::fabs(frontier.lower(budget) - greedy_time), 1e-6);
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"reduce_rides before exact solving", 2,
+		[&]()
+		{
+			for (int budget : { 50, 500, 5000 })
+			{
+				RideReduction reduction = reduce_rides(*filtered_rides, budget);
+				TEST_LT("few rides left undecided", reduction.free.size(), 64);
+				
+				int fixed_cost;
+				double fixed_time;
+				sum_ride_vector(reduction.fixed, fixed_cost, fixed_time);
+				TEST_EQUAL("fixed cost leaves the budget", budget - fixed_cost, reduction.free_budget);
+				
+				auto exact = dynamic_max_time(*filtered_rides, budget);
+				auto reduced = reduced_dynamic_max_time(*filtered_rides, budget);
+				int exact_cost, reduced_cost;
+				double exact_time, reduced_time;
+				sum_ride_vector(*exact, exact_cost, exact_time);
+				sum_ride_vector(*reduced, reduced_cost, reduced_time);
+				TEST_LE("within budget", reduced_cost, budget);
+				TEST_LT("same time as dynamic", std::fabs(exact_time - reduced_time), 1e-6);
+				
+				if (reduction.free.size() <= 20)
+				{
+					auto searched = reduced_exhaustive_max_time(*filtered_rides, budget);
+					int searched_cost;
+					double searched_time;
+					sum_ride_vector(*searched, searched_cost, searched_time);
+					TEST_LE("within budget", searched_cost, budget);
+					TEST_LT("same time as dynamic", std::fabs(exact_time - searched_time), 1e-6);
+				}
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"ride count limit", 2,
+		[&]()
+		{
+			auto small_rides = filter_ride_vector(*filtered_rides, 1, 2000, 14);
+			for (size_t max_rides = 0; max_rides <= small_rides->size(); max_rides++)
+			{
+				auto dynamic = dynamic_max_time(*small_rides, 2000, max_rides);
+				auto exhaustive = exhaustive_max_time(*small_rides, 2000, max_rides);
+				TEST_LE("dynamic respects the limit", dynamic->size(), max_rides);
+				TEST_LE("exhaustive respects the limit", exhaustive->size(), max_rides);
+				
+				int dynamic_cost, exhaustive_cost;
+				double dynamic_time, exhaustive_time;
+				sum_ride_vector(*dynamic, dynamic_cost, dynamic_time);
+				sum_ride_vector(*exhaustive, exhaustive_cost, exhaustive_time);
+				TEST_LE("within budget", dynamic_cost, 2000);
+				TEST_LE("within budget", exhaustive_cost, 2000);
+				TEST_LT("exhaustive and dynamic get the same answer", std::fabs(dynamic_time - exhaustive_time), 1e-6);
+			}
+			
+			auto unlimited = dynamic_max_time(*filtered_rides, 500);
+			auto limited = dynamic_max_time(*filtered_rides, 500, filtered_rides->size());
+			TEST_EQUAL("no limit is dynamic_max_time", unlimited->size(), limited->size());
+			
+			auto three = dynamic_max_time(*filtered_rides, 500, 3);
+			TEST_EQUAL("three rides", 3, three->size());
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"conflict_max_time", 2,
+		[&]()
+		{
+			// brute force reference on a small instance with a ring of conflicts
+			auto small_rides = filter_ride_vector(*filtered_rides, 1, 2000, 16);
+			size_t n = small_rides->size();
+			ConflictGraph ring(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				ring.add_conflict(i, (i + 1) % n);
+			}
+			double expected_time = 0;
+			for (uint64_t bits = 0; bits < (uint64_t(1) << n); bits++)
+			{
+				int cost = 0;
+				double time = 0;
+				bool compatible = true;
+				for (size_t i = 0; i < n; i++)
+				{
+					if ((bits >> i) & 1)
+					{
+						cost += (*small_rides)[i]->cost();
+						time += (*small_rides)[i]->time();
+						compatible = compatible && !((bits >> ((i + 1) % n)) & 1);
+					}
+				}
+				if (compatible && cost <= 2000)
+				{
+					expected_time = std::max(expected_time, time);
+				}
+			}
+			for (size_t threads : { 1, 4 })
+			{
+				auto soln = conflict_max_time(*small_rides, 2000, ring, threads);
+				int cost;
+				double time;
+				sum_ride_vector(*soln, cost, time);
+				TEST_LE("within budget", cost, 2000);
+				TEST_LT("same time as brute force", std::fabs(expected_time - time), 1e-6);
+				for (size_t a = 0; a < soln->size(); a++)
+				{
+					for (size_t b = a + 1; b < soln->size(); b++)
+					{
+						TEST_FALSE("no conflicting pair", ring.conflicts(
+							std::find(small_rides->begin(), small_rides->end(), (*soln)[a]) - small_rides->begin(),
+							std::find(small_rides->begin(), small_rides->end(), (*soln)[b]) - small_rides->begin()
+						));
+					}
+				}
+			}
+			
+			// no conflicts: same answer as the dynamic algorithm, over hundreds of rides
+			auto many_rides = filter_ride_vector(*filtered_rides, 1, 2500, 400);
+			ConflictGraph none(many_rides->size());
+			auto unconstrained = conflict_max_time(*many_rides, 500, none, 2);
+			auto dynamic = dynamic_max_time(*many_rides, 500);
+			int unconstrained_cost, dynamic_cost;
+			double unconstrained_time, dynamic_time;
+			sum_ride_vector(*unconstrained, unconstrained_cost, unconstrained_time);
+			sum_ride_vector(*dynamic, dynamic_cost, dynamic_time);
+			TEST_LT("same time as dynamic", std::fabs(dynamic_time - unconstrained_time), 1e-6);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"branch_bound_max_time", 2,
+		[&]()
+		{
+			std::unique_ptr<RideVector> soln;
+			
+			soln = branch_bound_max_time(trivial_rides, 3);
+			TEST_TRUE("empty solution", soln->empty());
+			soln = branch_bound_max_time(trivial_rides, -1);
+			TEST_TRUE("empty solution for a negative budget", soln->empty());
+			soln = branch_bound_max_time(*filtered_rides, -5, 2);
+			TEST_TRUE("empty solution for a negative budget", soln->empty());
+			soln = branch_bound_max_time(trivial_rides, 9);
+			TEST_EQUAL("Speedway only", 1, soln->size());
+			TEST_EQUAL("Speedway only", "test Speedway", (*soln)[0]->description());
+			soln = branch_bound_max_time(trivial_rides, 14);
+			TEST_EQUAL("Ferris Wheel and Speedway", 2, soln->size());
+			
+			for (int budget : { 50, 500, 5000 })
+			{
+				auto dynamic = dynamic_max_time(*filtered_rides, budget);
+				int dynamic_cost;
+				double dynamic_time;
+				sum_ride_vector(*dynamic, dynamic_cost, dynamic_time);
+				
+				// several workers, and a node limit small enough to force the depth-first fallback
+				for (size_t threads : { 1, 3 })
+				{
+					for (size_t node_limit : { 1, 4096 })
+					{
+						soln = branch_bound_max_time(*filtered_rides, budget, threads, node_limit);
+						int cost;
+						double time;
+						sum_ride_vector(*soln, cost, time);
+						TEST_LE("within budget", cost, budget);
+						TEST_LT("same time as dynamic", std::fabs(dynamic_time - time), 1e-6);
+					}
+				}
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"pinned and banned rides", 2,
+		[&]()
+		{
+			RideVector none;
+			RideVector ferris_wheel(1, trivial_rides[0]), speedway(1, trivial_rides[1]);
+			std::unique_ptr<RideVector> soln;
+			
+			soln = pinned_dynamic_max_time(trivial_rides, 14, none, ferris_wheel);
+			TEST_EQUAL("Ferris Wheel banned", 1, soln->size());
+			TEST_EQUAL("Ferris Wheel banned", "test Speedway", (*soln)[0]->description());
+			
+			soln = pinned_exhaustive_max_time(trivial_rides, 10, speedway, none);
+			TEST_EQUAL("Speedway pinned", 1, soln->size());
+			TEST_EQUAL("Speedway pinned", "test Speedway", (*soln)[0]->description());
+			
+			TEST_FALSE("pinned rides over budget", pinned_dynamic_max_time(trivial_rides, 3, speedway, none));
+			TEST_FALSE("pinned and banned", pinned_exhaustive_max_time(trivial_rides, 14, speedway, speedway));
+			
+			// pin the first two and ban the next two rides of the small instance
+			auto small_rides = filter_ride_vector(*filtered_rides, 1, 2000, 18);
+			RideVector include(small_rides->begin(), small_rides->begin() + 2);
+			RideVector exclude(small_rides->begin() + 2, small_rides->begin() + 4);
+			auto dynamic = pinned_dynamic_max_time(*small_rides, 600, include, exclude);
+			auto exhaustive = pinned_exhaustive_max_time(*small_rides, 600, include, exclude);
+			TEST_TRUE("non-null", dynamic);
+			TEST_TRUE("non-null", exhaustive);
+			for (auto& ride : include)
+			{
+				TEST_TRUE("pinned ride chosen", std::find(dynamic->begin(), dynamic->end(), ride) != dynamic->end());
+			}
+			for (auto& ride : exclude)
+			{
+				TEST_TRUE("banned ride left out", std::find(dynamic->begin(), dynamic->end(), ride) == dynamic->end());
+			}
+			int dynamic_cost, exhaustive_cost;
+			double dynamic_time, exhaustive_time;
+			sum_ride_vector(*dynamic, dynamic_cost, dynamic_time);
+			sum_ride_vector(*exhaustive, exhaustive_cost, exhaustive_time);
+			TEST_LE("within budget", dynamic_cost, 600);
+			TEST_LT("exhaustive and dynamic get the same answer", std::fabs(dynamic_time - exhaustive_time), 1e-6);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"scenario_max_time", 2,
+		[&]()
+		{
+			auto rides = filter_ride_vector(*filtered_rides, 1, 2500, 300);
+			std::vector<RideScenario> scenarios =
+			{
+				{ 500, {} },
+				{ 800, { { 0, false, 1, 900 } } },
+				{ 500, { { 0, false, 1, 900 }, { 5, true, 0, 0 } } },
+				{ 300, { { 5, true, 0, 0 }, { 17, false, 200, 12 } } },
+				{ 650, { { 17, false, 3, 400 }, { 42, false, 25, 700 }, { 5, true, 0, 0 } } },
+				{ -1, { { 17, false, 3, 400 } } },
+			};
+			auto results = scenario_max_time(*rides, scenarios);
+			TEST_EQUAL("one answer per scenario", scenarios.size(), results.size());
+			
+			for (size_t s = 0; s < scenarios.size(); s++)
+			{
+				// apply the overrides by hand and solve from scratch
+				RideVector edited(*rides);
+				std::vector<bool> removed(rides->size(), false);
+				for (const RideOverride& change : scenarios[s].overrides)
+				{
+					removed[change.index] = change.removed;
+					if (!change.removed)
+					{
+						edited[change.index] = std::make_shared<RideItem>(
+							(*rides)[change.index]->description(), change.cost, change.time);
+					}
+				}
+				RideVector available;
+				for (size_t i = 0; i < edited.size(); i++)
+				{
+					if (!removed[i])
+					{
+						available.push_back(edited[i]);
+					}
+				}
+				
+				int expected_cost, actual_cost;
+				double expected_time, actual_time;
+				sum_ride_vector(*dynamic_max_time(available, scenarios[s].total_cost), expected_cost, expected_time);
+				sum_ride_vector(*results[s], actual_cost, actual_time);
+				TEST_LE("within budget", actual_cost, std::max(scenarios[s].total_cost, 0));
+				TEST_LT("same time as solving from scratch", std::fabs(expected_time - actual_time), 1e-6);
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"RideCatalog copy-on-write versions", 2,
+		[&]()
+		{
+			RideCatalog base(*filtered_rides);
+			TEST_EQUAL("all rides offered", filtered_rides->size(), base.live_count());
+			
+			RideCatalog::Edit edit(base);
+			edit.set_cost(17, 1);
+			edit.set_time(17, 5000);
+			edit.remove(42);
+			size_t added = edit.add("test Teacups", 3, 700);
+			RideCatalog what_if = edit.commit();
+			
+			TEST_EQUAL("base unchanged", (*filtered_rides)[17]->cost(), base.cost(17));
+			TEST_EQUAL("base unchanged", (*filtered_rides)[17], base.item(17));
+			TEST_TRUE("base unchanged", base.offered(42));
+			TEST_EQUAL("base unchanged", filtered_rides->size(), base.size());
+			
+			TEST_EQUAL("edited cost", 1, what_if.cost(17));
+			TEST_EQUAL("edited item", 5000, what_if.item(17)->time());
+			TEST_FALSE("removed", what_if.offered(42));
+			TEST_EQUAL("added", "test Teacups", what_if.item(added)->description());
+			TEST_EQUAL("live count", base.live_count(), what_if.live_count());
+			
+			// only the first chunk of each column (rides 17 and 42), and the last one
+			// if the appended ride went into it, were copied
+			size_t chunks = (base.size() + CATALOG_CHUNK_SIZE - 1) / CATALOG_CHUNK_SIZE;
+			size_t copied = base.size() % CATALOG_CHUNK_SIZE == 0 ? 4 : 8;
+			TEST_EQUAL("untouched chunks shared", 4 * chunks - copied, what_if.shared_chunks(base));
+			
+			TEST_TRUE("lineage", what_if.descends_from(base.version()));
+			TEST_FALSE("lineage", base.descends_from(what_if.version()));
+			
+			// further edits do not leak into the committed version
+			edit.set_cost(17, 2);
+			RideCatalog again = edit.commit();
+			TEST_EQUAL("committed version unchanged", 1, what_if.cost(17));
+			TEST_EQUAL("next version", 2, again.cost(17));
+			TEST_EQUAL("lineage", what_if.version(), again.ancestors()[0]);
+			
+			auto rides = what_if.rides();
+			TEST_EQUAL("rides offered", what_if.live_count(), rides->size());
+			auto soln = dynamic_max_time(*rides, 1);
+			TEST_EQUAL("edited ride chosen", 1, soln->size());
+			TEST_EQUAL("edited ride chosen", 5000, (*soln)[0]->time());
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"RideChangeLog", 2,
+		[&]()
+		{
+			const std::string snapshot_path = "changelog_test_snapshot.csv", log_path = "changelog_test.log";
+			{
+				std::ofstream snapshot(snapshot_path);
+				snapshot << "Item^Cost^Time\n" << "test Ferris Wheel^10^20\n" << "test Speedway^4^5\n" << "test Carousel^6^7.25\n";
+			}
+			std::remove(log_path.c_str());
+			
+			RideChangeLog log(snapshot_path, log_path);
+			TEST_TRUE("load", log.load());
+			TEST_EQUAL("snapshot rides", 3, log.catalog().live_count());
+			
+			std::vector<ChangeKind> seen;
+			log.subscribe([&](const ChangeRecord& record, const RideCatalog&) { seen.push_back(record.kind); });
+			
+			TEST_TRUE("reprice", log.append(ChangeRecord{ CHANGE_REPRICE, 1, 3, 0, "" }));
+			TEST_TRUE("add", log.append(ChangeRecord{ CHANGE_ADD, 0, 8, 30.5, "test Teacups" }));
+			TEST_TRUE("remove", log.append(ChangeRecord{ CHANGE_REMOVE, 0, 0, 0, "" }));
+			TEST_TRUE("retime", log.append(ChangeRecord{ CHANGE_RETIME, 2, 0, 9.5, "" }));
+			TEST_FALSE("removed ride cannot change", log.append(ChangeRecord{ CHANGE_REPRICE, 0, 5, 0, "" }));
+			TEST_FALSE("no such ride", log.append(ChangeRecord{ CHANGE_RETIME, 9, 0, 1, "" }));
+			TEST_FALSE("description with a field separator", log.append(ChangeRecord{ CHANGE_ADD, 0, 8, 1, "test Tea^cups" }));
+			TEST_FALSE("description with a newline", log.append(ChangeRecord{ CHANGE_ADD, 0, 8, 1, "test Tea\ncups" }));
+			TEST_FALSE("description too long for the log", log.append(ChangeRecord{ CHANGE_ADD, 0, 8, 1, std::string(65536, 'x') }));
+			TEST_TRUE("longest description", log.append(ChangeRecord{ CHANGE_ADD, 0, 8, 1, std::string(65535, 'x') }));
+			TEST_TRUE("remove", log.append(ChangeRecord{ CHANGE_REMOVE, 4, 0, 0, "" }));
+			TEST_EQUAL("subscribers told", 6, seen.size());
+			TEST_EQUAL("tail", 6, log.tail_size());
+			
+			// a torn record at the end is ignored
+			{
+				std::ofstream torn(log_path, std::ios::binary | std::ios::app);
+				torn.write("\x20\x00\x00\x00\x03", 5);
+			}
+			
+			auto same_rides = [&](const RideCatalog& a, const RideCatalog& b)
+			{
+				auto left = a.rides(), right = b.rides();
+				TEST_EQUAL("same rides", left->size(), right->size());
+				for (size_t i = 0; i < left->size(); i++)
+				{
+					TEST_EQUAL("same rides", (*left)[i]->description(), (*right)[i]->description());
+					TEST_EQUAL("same rides", (*left)[i]->cost(), (*right)[i]->cost());
+					TEST_EQUAL("same rides", (*left)[i]->time(), (*right)[i]->time());
+				}
+			};
+			
+			RideChangeLog reloaded(snapshot_path, log_path);
+			TEST_TRUE("reload", reloaded.load());
+			same_rides(log.catalog(), reloaded.catalog());
+			TEST_EQUAL("replayed speedway price", 3, reloaded.catalog().cost(1));
+			TEST_FALSE("replayed removal", reloaded.catalog().offered(0));
+			
+			auto read_file = [](const std::string& path)
+			{
+				std::ifstream in(path, std::ios::binary);
+				return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			};
+			auto write_file = [](const std::string& path, const std::string& bytes)
+			{
+				std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+			};
+			std::string old_log = read_file(log_path);
+			
+			TEST_TRUE("compaction", log.compact_async().get());
+			TEST_EQUAL("log emptied", 0, log.tail_size());
+			TEST_EQUAL("subscribers told", CHANGE_COMPACTED, seen.back());
+			TEST_EQUAL("renumbered", 3, log.catalog().size());
+			TEST_TRUE("changes after compaction", log.append(ChangeRecord{ CHANGE_REPRICE, 0, 2, 0, "" }));
+			
+			RideChangeLog compacted(snapshot_path, log_path);
+			TEST_TRUE("reload after compaction", compacted.load());
+			same_rides(log.catalog(), compacted.catalog());
+			auto snapshot = load_ride_database(snapshot_path);
+			TEST_TRUE("snapshot loads", snapshot != nullptr);
+			TEST_EQUAL("snapshot holds the live rides", 3, snapshot->size());
+			
+			// a snapshot that cannot be replaced leaves the old pair in use
+			std::rename(snapshot_path.c_str(), (snapshot_path + ".moved").c_str());
+			mkdir(snapshot_path.c_str(), 0700);
+			TEST_FALSE("compaction fails", log.compact());
+			TEST_TRUE("changes after failed compaction", log.append(ChangeRecord{ CHANGE_RETIME, 1, 0, 12, "" }));
+			rmdir(snapshot_path.c_str());
+			std::rename((snapshot_path + ".moved").c_str(), snapshot_path.c_str());
+			TEST_FALSE("no leftover snapshot", std::ifstream(snapshot_path + ".compacting").good());
+			RideChangeLog kept(snapshot_path, log_path);
+			TEST_TRUE("reload after failed compaction", kept.load());
+			same_rides(log.catalog(), kept.catalog());
+			
+			// a compaction stopped before renaming its snapshot is discarded
+			write_file(snapshot_path + ".compacting", "Item^Cost^Time\ntest Bumper Cars^5^6\n");
+			write_file(log_path + ".compacting", "RIDELOG1");
+			RideChangeLog discarded(snapshot_path, log_path);
+			TEST_TRUE("discard an unfinished compaction", discarded.load());
+			same_rides(log.catalog(), discarded.catalog());
+			TEST_FALSE("leftovers removed", std::ifstream(log_path + ".compacting").good());
+			
+			// one stopped between the renames is finished
+			write_file(log_path + ".compacting", read_file(log_path));
+			write_file(log_path, old_log);
+			RideChangeLog finished(snapshot_path, log_path);
+			TEST_TRUE("finish an interrupted compaction", finished.load());
+			same_rides(log.catalog(), finished.catalog());
+			TEST_FALSE("leftovers removed", std::ifstream(log_path + ".compacting").good());
+			
+			// a log written for another snapshot is refused
+			{
+				std::ofstream snapshot(snapshot_path, std::ios::app);
+				snapshot << "test Bumper Cars^5^6\n";
+			}
+			RideChangeLog mismatched(snapshot_path, log_path);
+			TEST_FALSE("log for another snapshot", mismatched.load());
+			
+			std::remove(snapshot_path.c_str());
+			std::remove(log_path.c_str());
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"filter_ride_vector longest rides", 2,
+		[&]()
+		{
+			// reference: every match, sorted longest first
+			RideVector expected;
+			for (auto& ride : *all_rides)
+			{
+				if (ride->time() > 0 && ride->time() >= 100 && ride->time() <= 500)
+				{
+					expected.push_back(ride);
+				}
+			}
+			std::stable_sort(expected.begin(), expected.end(),
+				[](const std::shared_ptr<RideItem>& a, const std::shared_ptr<RideItem>& b) { return a->time() > b->time(); });
+			
+			for (size_t threads : { 1, 4 })
+			{
+				for (int total_size : { 0, 1, 10, 1000, 100000 })
+				{
+					auto longest = filter_ride_vector(*all_rides, 100, 500, total_size, FILTER_LONGEST, threads);
+					TEST_EQUAL("total_size", std::min<size_t>(total_size, expected.size()), longest->size());
+					for (size_t i = 0; i < longest->size(); i++)
+					{
+						TEST_EQUAL("longest first, ties in source order", expected[i], (*longest)[i]);
+					}
+				}
+			}
+			
+			auto first = filter_ride_vector(*all_rides, 100, 500, 10, FILTER_FIRST_MATCHES);
+			TEST_EQUAL("first matches mode unchanged", "again amazing mystical vertigo", (*first)[0]->description());
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"compressed_dynamic_max_time", 2,
+		[&]()
+		{
+			int trivial_costs[] = { 10, 4 };
+			uint64_t reachable[1];
+			TEST_EQUAL("reachable totals", 4, reachable_costs(trivial_costs, 2, 14, reachable));
+			TEST_EQUAL("reachable totals", (1 << 0) | (1 << 4) | (1 << 10) | (1 << 14), reachable[0]);
+			TEST_EQUAL("reachable totals under budget", 2, reachable_costs(trivial_costs, 2, 9, reachable));
+			TEST_EQUAL("no totals for a negative budget", 0, reachable_costs(trivial_costs, 2, -1, nullptr));
+			
+			auto soln = compressed_dynamic_max_time(trivial_rides, 3);
+			TEST_TRUE("nothing fits", soln->empty());
+			soln = compressed_dynamic_max_time(trivial_rides, 9);
+			TEST_EQUAL("Speedway only", 1, soln->size());
+			TEST_EQUAL("Speedway only", "test Speedway", (*soln)[0]->description());
+			soln = compressed_dynamic_max_time(trivial_rides, 14);
+			TEST_EQUAL("both rides", 2, soln->size());
+			
+			for (int budget : { 0, 1, 500, 5000 })
+			{
+				auto exact = dynamic_max_time(*filtered_rides, budget);
+				auto compressed = compressed_dynamic_max_time(*filtered_rides, budget);
+				int exact_cost, compressed_cost;
+				double exact_time, compressed_time;
+				sum_ride_vector(*exact, exact_cost, exact_time);
+				sum_ride_vector(*compressed, compressed_cost, compressed_time);
+				TEST_LT("same time as dynamic_max_time", std::fabs(exact_time - compressed_time), 1e-6);
+				TEST_TRUE("within budget", compressed_cost <= budget);
+			}
+			
+			// coarse prices: only multiples of 5 are reachable
+			RideVector coarse;
+			for (size_t i = 0; i < 40; i++)
+			{
+				auto& ride = (*filtered_rides)[i];
+				coarse.push_back(std::make_shared<RideItem>(ride->description(), 5 * (1 + ride->cost() % 20), ride->time()));
+			}
+			std::vector<int> coarse_costs;
+			for (auto& ride : coarse)
+			{
+				coarse_costs.push_back(ride->cost());
+			}
+			std::vector<uint64_t> coarse_reachable((1000 + 64) / 64);
+			TEST_TRUE("compressed", reachable_costs(coarse_costs.data(), coarse.size(), 1000, coarse_reachable.data()) <= 201);
+			int exact_cost, compressed_cost;
+			double exact_time, compressed_time;
+			sum_ride_vector(*dynamic_max_time(coarse, 1000), exact_cost, exact_time);
+			sum_ride_vector(*compressed_dynamic_max_time(coarse, 1000), compressed_cost, compressed_time);
+			TEST_LT("coarse prices", std::fabs(exact_time - compressed_time), 1e-6);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"C entry points", 2,
+		[&]()
+		{
+			TEST_EQUAL("ABI version", MAXTIME_ABI_VERSION, maxtime_abi_version());
+			
+			std::vector<int32_t> costs;
+			std::vector<double> times;
+			for (auto& ride : *filtered_rides)
+			{
+				costs.push_back(ride->cost());
+				times.push_back(ride->time());
+			}
+			
+			std::vector<size_t> selected(costs.size());
+			size_t count;
+			double total_time;
+			TEST_EQUAL("reserve", MAXTIME_OK, maxtime_reserve(costs.size(), 5000));
+			size_t allocations = thread_workspace().allocations();
+			for (int budget : { 500, 5000 })
+			{
+				TEST_EQUAL("dynamic", MAXTIME_OK,
+					maxtime_dynamic(costs.data(), times.data(), costs.size(), budget, selected.data(), selected.size(), &count, &total_time));
+				
+				auto expected = dynamic_max_time(*filtered_rides, budget);
+				int expected_cost;
+				double expected_time;
+				sum_ride_vector(*expected, expected_cost, expected_time);
+				TEST_EQUAL("same rides as dynamic_max_time", expected->size(), count);
+				TEST_LT("same time as dynamic_max_time", std::fabs(expected_time - total_time), 1e-6);
+				TEST_TRUE("increasing indices", std::is_sorted(selected.begin(), selected.begin() + count));
+			}
+			TEST_EQUAL("no allocation after reserve", allocations, thread_workspace().allocations());
+			
+			TEST_EQUAL("buffer too small", MAXTIME_BUFFER_TOO_SMALL,
+				maxtime_dynamic(costs.data(), times.data(), costs.size(), 500, selected.data(), 1, &count, &total_time));
+			TEST_TRUE("count needed", count > 1);
+			TEST_EQUAL("null arrays", MAXTIME_INVALID_ARGUMENT,
+				maxtime_dynamic(nullptr, times.data(), costs.size(), 500, selected.data(), selected.size(), &count, &total_time));
+			
+			int32_t trivial_costs[] = { 10, 4, 0 };
+			double trivial_times[] = { 20, 5, 1 };
+			TEST_EQUAL("exhaustive", MAXTIME_OK,
+				maxtime_exhaustive(trivial_costs, trivial_times, 2, 9, selected.data(), selected.size(), &count, &total_time));
+			TEST_EQUAL("Speedway only", 1, count);
+			TEST_EQUAL("Speedway only", 1, selected[0]);
+			TEST_EQUAL("Speedway only", 5, total_time);
+			TEST_EQUAL("zero cost", MAXTIME_INVALID_ARGUMENT,
+				maxtime_exhaustive(trivial_costs, trivial_times, 3, 9, selected.data(), selected.size(), &count, &total_time));
+			TEST_EQUAL("too many rides", MAXTIME_TOO_MANY_RIDES,
+				maxtime_exhaustive(costs.data(), times.data(), 64, 500, selected.data(), selected.size(), &count, &total_time));
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"QueryBatchSolver", 2,
+		[&]()
+		{
+			QueryBatchSolver solver(trivial_rides, 16, 2);
+			std::istringstream text(
+				"# comment\n"
+				"0 100 2 9 dynamic\n"
+				"\n"
+				"0 100 2 14 exhaustive\n"
+				"0 100 2 9 dynamic\n"
+				"0 100 2 9 warp_drive\n"
+				"0 100 2\n"
+				"0 10 1 100 compressed\n"
+				"0 100 -1 9 dynamic\n");
+			std::ostringstream answers;
+			solver.run_text(text, answers);
+			TEST_EQUAL("text answers",
+				"1 4 5 1\n"
+				"2 14 25 0 1\n"
+				"3 4 5 1\n"
+				"4 error unknown engine warp_drive\n"
+				"5 error want: min_time max_time total_size budget engine\n"
+				"6 4 5 1\n"
+				"7 error total_size is negative\n",
+				answers.str());
+			
+			std::istringstream again("0 100 2 9 dynamic\n0 100 2 14 exhaustive\n");
+			std::ostringstream cached;
+			size_t hits = solver.cache_hits();
+			solver.run_text(again, cached);
+			TEST_EQUAL("answered from the cache", hits + 2, solver.cache_hits());
+			TEST_EQUAL("cached answers", "1 4 5 1\n2 14 25 0 1\n", cached.str());
+			
+			BinaryQuery records[] = {
+				{ 0, 100, 2, 14, ENGINE_REDUCED, 0 },
+				{ 0, 100, 2, 3, ENGINE_BRANCH_BOUND, 0 },
+				{ 0, 100, 2, 3, 99, 0 },
+				{ std::nan(""), 100, 2, 14, ENGINE_DYNAMIC, 0 },
+				{ 0, HUGE_VAL, 2, 14, ENGINE_DYNAMIC, 0 }
+			};
+			std::string bytes(reinterpret_cast<const char*>(records), sizeof(records));
+			bytes += "xyz";
+			std::istringstream binary(bytes);
+			std::ostringstream binary_answers;
+			solver.run_binary(binary, binary_answers);
+			TEST_EQUAL("binary answers",
+				"1 14 25 0 1\n"
+				"2 0 0\n"
+				"3 error unknown engine 99\n"
+				"4 error time window is not finite\n"
+				"5 error time window is not finite\n"
+				"6 error truncated record\n",
+				binary_answers.str());
+			
+			// the same answers as calling the engine directly, with catalog indices
+			QueryBatchSolver catalog_solver(*all_rides);
+			std::istringstream query("1 2500 8064 500 dynamic\n");
+			std::ostringstream answer;
+			catalog_solver.run_text(query, answer);
+			std::istringstream fields(answer.str());
+			size_t number;
+			int total_cost;
+			double total_time;
+			fields >> number >> total_cost >> total_time;
+			TEST_LT("same time as dynamic_max_time", std::fabs(total_time - 9564.92), 0.01);
+			int cost_of_indices = 0;
+			for (size_t i; fields >> i; )
+			{
+				cost_of_indices += (*all_rides)[i]->cost();
+			}
+			TEST_EQUAL("indices into the catalog", total_cost, cost_of_indices);
+			
+			// exhaustive search over more rides than a stream can wait for is refused
+			std::istringstream large("1 2500 26 500 exhaustive\n1 2500 25 500 exhaustive\n");
+			std::ostringstream large_answers;
+			catalog_solver.run_text(large, large_answers);
+			std::string refused = large_answers.str().substr(0, large_answers.str().find('\n'));
+			TEST_EQUAL("exhaustive over too many rides", "1 error exhaustive search takes at most 25 rides", refused);
+			TEST_TRUE("exhaustive within the limit", large_answers.str().find("\n2 error") == std::string::npos);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"RideOrderings", 2,
+		[&]()
+		{
+			// radix sort against a stable comparison sort, with negative, tied and zero keys
+			std::vector<double> values;
+			for (size_t i = 0; i < 5000; i++)
+			{
+				values.push_back(double((i * 7919) % 1013) - 500.25 * (i % 3));
+			}
+			values.push_back(-0.0);
+			values.push_back(0.0);
+			std::vector<uint64_t> keys;
+			for (double value : values)
+			{
+				keys.push_back(ordered_key(value));
+			}
+			std::vector<size_t> expected(values.size());
+			std::iota(expected.begin(), expected.end(), 0);
+			std::stable_sort(expected.begin(), expected.end(), [&](size_t a, size_t b) { return values[a] < values[b]; });
+			for (size_t threads : { 1, 4 })
+			{
+				std::vector<size_t> order;
+				radix_sort_indices(keys, order, threads);
+				TEST_EQUAL("radix sort", expected.size(), order.size());
+				for (size_t k = 0; k + 1 < order.size(); k++)
+				{
+					TEST_TRUE("radix sort", values[order[k]] <= values[order[k + 1]]);
+					TEST_TRUE("radix sort is stable", values[order[k]] < values[order[k + 1]] || order[k] < order[k + 1]);
+				}
+			}
+			
+			RideOrderings orderings(*filtered_rides, 3);
+			TEST_EQUAL("lazy", 0, orderings.sorts());
+			std::vector<int> costs;
+			std::vector<double> times;
+			for (auto& ride : *filtered_rides)
+			{
+				costs.push_back(ride->cost());
+				times.push_back(ride->time());
+			}
+			// equal ratios may round either way, e.g. 30.6 / 6 and 5.1 / 1
+			const std::vector<size_t>& by_ratio = orderings.by_ratio();
+			for (size_t k = 0; k + 1 < by_ratio.size(); k++)
+			{
+				size_t a = by_ratio[k], b = by_ratio[k + 1];
+				TEST_FALSE("by ratio", times[b] * costs[a] > times[a] * costs[b] * (1 + 1e-12));
+			}
+			TEST_EQUAL("sorted once", &by_ratio, &orderings.by_ratio());
+			TEST_EQUAL("sorted once", 1, orderings.sorts());
+			
+			TimeFrontier sorted(*filtered_rides), shared(*filtered_rides, &orderings);
+			TEST_EQUAL("cost and ratio orders", 2, orderings.sorts());
+			for (int budget : { 0, 7, 500, 5000 })
+			{
+				TEST_LT("frontier upper", std::fabs(sorted.upper(budget) - shared.upper(budget)), 1e-6);
+				TEST_LT("frontier lower", std::fabs(sorted.lower(budget) - shared.lower(budget)), 1e-6);
+				
+				int expected_cost, cost;
+				double expected_time, time;
+				sum_ride_vector(*dynamic_max_time(*filtered_rides, budget), expected_cost, expected_time);
+				sum_ride_vector(*reduced_dynamic_max_time(*filtered_rides, budget, &orderings), cost, time);
+				TEST_LT("reduced_dynamic_max_time", std::fabs(expected_time - time), 1e-6);
+				sum_ride_vector(*branch_bound_max_time(*filtered_rides, budget, 2, 4096, &orderings), cost, time);
+				TEST_LT("branch_bound_max_time", std::fabs(expected_time - time), 1e-6);
+			}
+			TEST_EQUAL("shared by every engine", 2, orderings.sorts());
+			
+			RideOrderings all_orderings(*all_rides);
+			for (int total_size : { 0, 10, 100000 })
+			{
+				auto scanned = filter_ride_vector(*all_rides, 100, 500, total_size, FILTER_LONGEST);
+				auto walked = filter_ride_vector(*all_rides, 100, 500, total_size, all_orderings);
+				TEST_EQUAL("longest rides", scanned->size(), walked->size());
+				TEST_TRUE("longest rides", std::equal(scanned->begin(), scanned->end(), walked->begin()));
+			}
+			
+			// each catalog version has its own orderings
+			RideCatalog base(trivial_rides);
+			TEST_EQUAL("catalog orderings", 0, base.orderings().by_ratio()[0]);
+			RideCatalog::Edit edit(base);
+			edit.set_time(1, 100);
+			RideCatalog faster = edit.commit();
+			TEST_EQUAL("new version, new orderings", 1, faster.orderings().by_ratio()[0]);
+			TEST_EQUAL("old version unchanged", 0, base.orderings().by_ratio()[0]);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"count_selections and time_histogram", 2,
+		[&]()
+		{
+			auto within = count_selections(trivial_rides, 14);
+			TEST_EQUAL("nothing fits", 1, uint64_t(within[3]));
+			TEST_EQUAL("Speedway", 2, uint64_t(within[9]));
+			TEST_EQUAL("Ferris Wheel", 3, uint64_t(within[10]));
+			TEST_EQUAL("both", 4, uint64_t(within[14]));
+			TEST_TRUE("negative budget", count_selections(trivial_rides, -1).empty());
+			
+			// against enumeration
+			auto small_rides = filter_ride_vector(*filtered_rides, 1, 2500, 16);
+			const int budget = 300;
+			std::vector<uint64_t> exact(budget + 1, 0);
+			for (uint64_t bits = 0; bits < (uint64_t(1) << small_rides->size()); bits++)
+			{
+				int cost = 0;
+				for (size_t j = 0; j < small_rides->size(); j++)
+				{
+					cost += ((bits >> j) & 1) ? (*small_rides)[j]->cost() : 0;
+				}
+				if (cost <= budget)
+				{
+					exact[cost]++;
+				}
+			}
+			std::partial_sum(exact.begin(), exact.end(), exact.begin());
+			within = count_selections(*small_rides, budget);
+			auto modulo = count_selections_modulo(*small_rides, budget, 1009);
+			for (int b = 0; b <= budget; b++)
+			{
+				TEST_EQUAL("same as enumeration", exact[b], uint64_t(within[b]));
+				TEST_EQUAL("modular", exact[b] % 1009, modulo[b]);
+			}
+			
+			// all rides: beyond 2^64 within $100, beyond 2^128 within $500
+			within = count_selections(*all_rides, 500);
+			TEST_TRUE("beyond 64 bits", within[100] > (SelectionCount(1) << 64));
+			TEST_TRUE("not saturated", within[100] < SELECTION_COUNT_MAX);
+			TEST_EQUAL("saturated", SELECTION_COUNT_MAX, within[500]);
+			modulo = count_selections_modulo(*all_rides, 100, uint64_t(1) << 61);
+			TEST_EQUAL("modular matches exact", uint64_t(within[100] % (SelectionCount(1) << 61)), modulo[100]);
+			
+			TimeHistogram histogram = time_histogram(trivial_rides, 14, 5, 10);
+			TEST_EQUAL("budgets", 14, histogram.total_cost());
+			const SelectionCount* counts = histogram.counts(14);
+			TEST_EQUAL("empty selection", 1, uint64_t(counts[0]));
+			TEST_EQUAL("Speedway", 1, uint64_t(counts[1]));
+			TEST_EQUAL("Ferris Wheel", 1, uint64_t(counts[4]));
+			TEST_EQUAL("both", 1, uint64_t(counts[5]));
+			TEST_EQUAL("only Speedway within 9", 0, uint64_t(histogram.counts(9)[4]));
+			
+			histogram = time_histogram(*small_rides, budget, 25, 40);
+			for (int b : { 0, 100, budget })
+			{
+				SelectionCount total = 0;
+				for (size_t k = 0; k < histogram.bins(); k++)
+				{
+					total += histogram.counts(b)[k];
+				}
+				TEST_EQUAL("every selection in one bin", exact[b], uint64_t(total));
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"roofline placement", 2,
+		[&]()
+		{
+			RooflinePeaks peaks = { 10e9, 100e9, 50e9, 20e9 };
+
+			// 0.1 flop/byte streaming from DRAM: the bandwidth roof, 1 GFLOP/s
+			KernelSample streaming = { "stream", "", true, 1.0, 1e9, 1e8, 1e9 };
+			RooflinePoint point = place_on_roofline(streaming, peaks);
+			TEST_EQUAL("dram roof", "dram", point.roof);
+			TEST_TRUE("memory bound", point.memory_bound);
+			TEST_LT("attainable", std::fabs(point.attainable_ops - 1e9), 1.0);
+			TEST_LT("achieved bandwidth", std::fabs(point.achieved_bandwidth - 1e9), 1.0);
+
+			// 10 integer ops/byte in cache: the integer compute roof
+			KernelSample dense = { "dense", "", false, 1.0, 1e6, 1e7, 4096 };
+			point = place_on_roofline(dense, peaks);
+			TEST_EQUAL("cache roof", "cache", point.roof);
+			TEST_FALSE("compute bound", point.memory_bound);
+			TEST_LT("integer peak", std::fabs(point.attainable_ops - 20e9), 1.0);
+
+			std::ostringstream csv, json;
+			write_roofline_csv(csv, peaks, { point });
+			write_roofline_json(json, peaks, { point });
+			TEST_TRUE("csv row", csv.str().find("\ndense,,int,") != std::string::npos);
+			TEST_TRUE("json bound", json.str().find("\"bound\": \"compute\"") != std::string::npos);
+		}
+	);
+
+	//
+	rubric.criterion(
+		"benchmark history", 2,
+		[&]()
+		{
+			BenchmarkRecord record = { "1", "abc123", "host \"a\"", "dynamic_max_time", { 0.5, 0.25 } };
+			BenchmarkRecord parsed;
+			TEST_TRUE("parses", parse_benchmark_record(format_benchmark_record(record), parsed));
+			TEST_EQUAL("host", record.host, parsed.host);
+			TEST_EQUAL("samples", 2, parsed.samples.size());
+			TEST_EQUAL("sample", 0.25, parsed.samples[1]);
+			TEST_FALSE("not a record", parse_benchmark_record("{\"run\": \"1\"}", parsed));
+
+			// clearly slower, same, and slower by too little to matter
+			std::vector<BenchmarkRecord> history;
+			std::vector<double> base, slow, fast, same;
+			for (int s = 0; s < 12; s++)
+			{
+				base.push_back(1.0 + 0.01 * s);
+				slow.push_back(1.5 + 0.01 * s);
+				same.push_back(1.0 + 0.01 * ((s * 5) % 12));
+				fast.push_back(1.02 + 0.01 * s);
+			}
+			history.push_back({ "1", "a", "h", "load", base });
+			history.push_back({ "1", "a", "h", "dynamic", base });
+			history.push_back({ "1", "a", "h", "filter", base });
+			history.push_back({ "2", "b", "h", "load", slow });
+			history.push_back({ "2", "b", "h", "dynamic", same });
+			history.push_back({ "2", "b", "h", "filter", fast });
+			TEST_EQUAL("runs", 2, benchmark_runs(history).size());
+
+			auto comparisons = compare_benchmark_runs(history, "1", "2");
+			TEST_EQUAL("compared", 3, comparisons.size());
+			TEST_TRUE("slower", comparisons[0].slower);
+			TEST_LT("significant", comparisons[0].p_value, 0.001);
+			TEST_FALSE("same", comparisons[1].slower);
+			TEST_GT("same not significant", comparisons[1].p_value, 0.1);
+			TEST_FALSE("negligible", comparisons[2].slower);
+		}
+	);
+
+	//
+	rubric.criterion(
+		"parallel report", 2,
+		[&]()
+		{
+			TEST_GE("thread cpu time", ThreadCpuTimer::now(), 0.0);
+			ResourceUsage usage = resource_usage();
+			TEST_GT("process cpu time", usage.user_seconds + usage.system_seconds, 0.0);
+
+			ParallelReport report;
+			auto longest = filter_ride_vector(*all_rides, 100, 500, 100, FILTER_LONGEST, 3, &report);
+			auto expected = filter_ride_vector(*all_rides, 100, 500, 100, FILTER_LONGEST, 1);
+			TEST_TRUE("same result", *longest == *expected);
+
+			auto phases = report.phases();
+			TEST_EQUAL("phases", 2, phases.size());
+			TEST_EQUAL("scan", "filter scan", phases[0].name);
+			TEST_EQUAL("scan threads", 3, phases[0].threads);
+			TEST_EQUAL("merge", "filter merge", phases[1].name);
+			TEST_GT("scan cpu", phases[0].cpu, 0.0);
+			TEST_GE("wait", phases[0].wait, 0.0);
+			TEST_LE("efficiency", phases[0].efficiency(), 1.05);
+
+			// repeated phases add up
+			filter_ride_vector(*all_rides, 100, 500, 100, FILTER_LONGEST, 3, &report);
+			TEST_EQUAL("runs", 2, report.phases()[0].runs);
+
+			ParallelReport search;
+			auto rides = filter_ride_vector(*all_rides, 1, 2500, 300);
+			branch_bound_max_time(*rides, 300, 2, 4096, nullptr, &search);
+			TEST_EQUAL("branch and bound phases", 2, search.phases().size());
+			TEST_EQUAL("search", "branch_bound search", search.phases()[1].name);
+			TEST_GE("spin", search.phases()[1].spin, 0.0);
+
+			std::ostringstream table;
+			search.write(table);
+			TEST_TRUE("table", table.str().find("branch_bound setup") != std::string::npos);
+		}
+	);
+
+	//
+	rubric.criterion(
+		"background indexes", 2,
+		[&]()
+		{
+			TEST_EQUAL("words", 5, description_words("A short tilt-a-whirl").size());
+			TEST_EQUAL("lowercase", "short", description_words("A SHORT ride")[1]);
+
+			// not started: every query takes the scan path
+			BackgroundRideIndexes indexes(*all_rides, false);
+			TEST_EQUAL("pending", INDEX_PENDING, indexes.state(INDEX_TIME_ORDER));
+			TEST_TRUE("no orderings yet", indexes.orderings() == nullptr);
+			auto scanned_longest = indexes.filter_longest(100, 500, 100);
+			auto scanned_cheap = indexes.rides_costing_at_most(10);
+			auto scanned_haunted = indexes.rides_with_keyword("Haunted");
+
+			indexes.start();
+			indexes.wait();
+			TEST_TRUE("ready", indexes.ready());
+			TEST_TRUE("orderings", indexes.orderings() != nullptr);
+
+			auto indexed_longest = indexes.filter_longest(100, 500, 100);
+			TEST_EQUAL("longest count", 100, indexed_longest->size());
+			TEST_TRUE("same longest", *scanned_longest == *indexed_longest);
+			TEST_FALSE("some cheap rides", scanned_cheap.empty());
+			TEST_TRUE("same cheap rides", scanned_cheap == indexes.rides_costing_at_most(10));
+			TEST_TRUE("none under the cheapest", indexes.rides_costing_at_most(5).empty());
+			TEST_EQUAL("haunted rides", 1584, scanned_haunted.size());
+			TEST_TRUE("same haunted rides", scanned_haunted == indexes.rides_with_keyword("haunted"));
+			TEST_TRUE("unknown word", indexes.rides_with_keyword("zeppelin").empty());
+
+			// queries while building are answered by whichever path is ready
+			BackgroundRideIndexes racing(*all_rides);
+			for (int q = 0; q < 20; q++)
+			{
+				auto longest = racing.filter_longest(100, 500, 100);
+				TEST_TRUE("same longest while building", *longest == *indexed_longest);
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"monte carlo waits", 2,
+		[&]()
+		{
+			// Random123 known answers
+			uint32_t zero = 0, ones = 0xffffffff, out[4];
+			philox4x32_10(&zero, &zero, 0, 0, 0, 0, 1, &out[0], &out[1], &out[2], &out[3]);
+			TEST_EQUAL("philox zero", 0x6627e8d5u, out[0]);
+			TEST_EQUAL("philox zero last", 0x9b00dbd8u, out[3]);
+			philox4x32_10(&ones, &ones, ones, ones, ones, ones, 1, &out[0], &out[1], &out[2], &out[3]);
+			TEST_EQUAL("philox ones", 0x408f276du, out[0]);
+			TEST_EQUAL("philox ones last", 0x6d5451fdu, out[3]);
+
+			auto rides = filter_ride_vector(*all_rides, 1, 2500, 60);
+			std::vector<double> mean_waits(rides->size());
+			for (size_t i = 0; i < rides->size(); i++)
+			{
+				mean_waits[i] = 5 + i % 7 * 5;
+			}
+			MonteCarloEvaluator serial(*rides, mean_waits, 4000, 7, 1);
+			ParallelReport report;
+			MonteCarloEvaluator parallel(*rides, mean_waits, 4000, 7, 3, { 5, 25, 50, 75, 95 }, &report);
+
+			// a ride's wait does not depend on which other rides are sampled with it
+			TEST_EQUAL("same wait", serial.waits(17, { 5 })[0], serial.waits(17, { 2, 5, 40 })[1]);
+
+			std::vector<size_t> dynamic_plan;
+			auto best = dynamic_max_time(*rides, 300);
+			for (auto& ride : *best)
+			{
+				dynamic_plan.push_back(std::find(rides->begin(), rides->end(), ride) - rides->begin());
+			}
+			std::vector<size_t> saa_plan = serial.sample_average_plan(300);
+			TEST_TRUE("same plan with more threads", saa_plan == parallel.sample_average_plan(300));
+
+			auto distributions = serial.evaluate({ dynamic_plan, saa_plan, {} });
+			auto parallel_distributions = parallel.evaluate({ dynamic_plan, saa_plan, {} });
+			TEST_EQUAL("plans", 3, distributions.size());
+			TEST_EQUAL("same mean with more threads", distributions[0].mean, parallel_distributions[0].mean);
+			TEST_EQUAL("same median with more threads", distributions[1].percentiles[2], parallel_distributions[1].percentiles[2]);
+
+			// both passes of the parallel evaluator are in its report
+			std::vector<ParallelReport::Phase> phases = report.phases();
+			TEST_EQUAL("one phase", 1, phases.size());
+			TEST_EQUAL("phase name", std::string("monte carlo scenarios"), phases[0].name);
+			TEST_EQUAL("phase threads", 3, phases[0].threads);
+			TEST_EQUAL("phase runs", 2, phases[0].runs);
+
+			// the mean is the ride times plus the mean waits, within sampling error
+			double expected = 0;
+			for (size_t i : dynamic_plan)
+			{
+				expected += (*rides)[i]->time() + mean_waits[i];
+			}
+			TEST_LT("mean", std::fabs(distributions[0].mean - expected), 4 * distributions[0].stddev / std::sqrt(4000.0));
+
+			// percentiles are ordered, and the empty plan takes no time
+			const PlanDistribution& dynamic = distributions[0];
+			TEST_LE("min", dynamic.min, dynamic.percentiles[0]);
+			for (size_t k = 1; k < dynamic.percentiles.size(); k++)
+			{
+				TEST_LE("ordered", dynamic.percentiles[k - 1], dynamic.percentiles[k]);
+			}
+			TEST_LE("max", dynamic.percentiles.back(), dynamic.max);
+			TEST_EQUAL("empty plan", 0.0, distributions[2].max);
+
+			// the sample average plan is best on average in the sampled scenarios
+			int saa_cost = 0;
+			for (size_t i : saa_plan)
+			{
+				saa_cost += (*rides)[i]->cost();
+			}
+			TEST_LE("within budget", saa_cost, 300);
+			TEST_GE("saa is best on average", distributions[1].mean, distributions[0].mean - 1e-6);
+		}
+	);
+
+	//
+	rubric.criterion(
+		"co-optimal selections", 2,
+		[&]()
+		{
+			// {A, B} and {C} both take 20 minutes within $4
+			RideVector tied;
+			tied.push_back(std::make_shared<RideItem>("A", 2, 10));
+			tied.push_back(std::make_shared<RideItem>("B", 2, 10));
+			tied.push_back(std::make_shared<RideItem>("C", 4, 20));
+			tied.push_back(std::make_shared<RideItem>("D", 1, 1));
+			auto optima = dynamic_co_optimal(tied, 4);
+			TEST_EQUAL("two optima", 2, optima.size());
+			TEST_EQUAL("one cap", 1, dynamic_co_optimal(tied, 4, 1).size());
+			TEST_EQUAL("none", 0, dynamic_co_optimal(tied, -1).size());
+			TEST_EQUAL("nothing fits", 1, dynamic_co_optimal(tied, 0).size());
+
+			// against every subset of small windows of ride.csv with rounded times
+			for (int window = 0; window < 6; window++)
+			{
+				RideVector rides;
+				for (int k = 0; k < 14; k++)
+				{
+					auto& ride = (*all_rides)[window * 97 + k * 13];
+					rides.push_back(std::make_shared<RideItem>(ride->description(), ride->cost() % 20 + 1, std::round(ride->time() / 100) * 100));
+				}
+				int budget = 40;
+
+				double best = 0;
+				std::set<std::vector<const RideItem*>> expected;
+				for (uint64_t bits = 0; bits < (uint64_t(1) << rides.size()); bits++)
+				{
+					int cost = 0;
+					double time = 0;
+					std::vector<const RideItem*> chosen;
+					for (size_t j = 0; j < rides.size(); j++)
+					{
+						if ((bits >> j) & 1)
+						{
+							cost += rides[j]->cost();
+							time += rides[j]->time();
+							chosen.push_back(rides[j].get());
+						}
+					}
+					if (cost > budget || time < best - 1e-6)
+					{
+						continue;
+					}
+					if (time > best + 1e-6)
+					{
+						best = time;
+						expected.clear();
+					}
+					expected.insert(chosen);
+				}
+
+				std::set<std::vector<const RideItem*>> found;
+				for (auto& selection : dynamic_co_optimal(rides, budget))
+				{
+					int cost;
+					double time;
+					sum_ride_vector(*selection, cost, time);
+					TEST_LE("within budget", cost, budget);
+					TEST_LT("optimal", std::fabs(time - best), 1e-6);
+					std::vector<const RideItem*> chosen;
+					for (auto& ride : *selection)
+					{
+						chosen.push_back(ride.get());
+					}
+					TEST_TRUE("distinct", found.insert(chosen).second);
+				}
+				TEST_TRUE("all optima", found == expected);
+			}
+
+			// the one dynamic_max_time returns is among them
+			auto rides = filter_ride_vector(*all_rides, 1, 2500, 200);
+			auto one = dynamic_max_time(*rides, 300);
+			bool listed = false;
+			for (auto& selection : dynamic_co_optimal(*rides, 300))
+			{
+				std::vector<const RideItem*> a, b;
+				for (auto& ride : *selection)
+				{
+					a.push_back(ride.get());
+				}
+				for (auto& ride : *one)
+				{
+					b.push_back(ride.get());
+				}
+				std::sort(a.begin(), a.end());
+				std::sort(b.begin(), b.end());
+				listed = listed || a == b;
+			}
+			TEST_TRUE("dynamic answer listed", listed);
+		}
+	);
+
+	//
+	rubric.criterion(
+		"exhaustive time frontier", 2,
+		[&]()
+		{
+			auto rides = filter_ride_vector(*all_rides, 1, 2500, 18);
+			int budget = 400;
+			auto exhaustive = exhaustive_time_frontier(*rides, budget);
+			auto dynamic = dynamic_time_frontier(*rides, budget);
+			TEST_EQUAL("size", size_t(budget) + 1, exhaustive.size());
+			TEST_EQUAL("dynamic size", size_t(budget) + 1, dynamic.size());
+			TEST_EQUAL("nothing within 0", 0.0, exhaustive[0]);
+
+			double worst = 0;
+			for (int b = 0; b <= budget; b++)
+			{
+				worst = std::max(worst, std::fabs(exhaustive[b] - dynamic[b]));
+				if (b > 0)
+				{
+					TEST_GE("nondecreasing", exhaustive[b], exhaustive[b - 1]);
+				}
+			}
+			TEST_LT("matches dynamic frontier", worst, 1e-6);
+
+			for (int b : { 37, 150, 400 })
+			{
+				int cost;
+				double time;
+				sum_ride_vector(*exhaustive_max_time(*rides, b), cost, time);
+				TEST_LT("matches exhaustive", std::fabs(exhaustive[b] - time), 1e-6);
+			}
+
+			// fewer rides than the Gray-coded block, and the trivial rides
+			auto few = filter_ride_vector(*all_rides, 1, 2500, 5);
+			auto few_exhaustive = exhaustive_time_frontier(*few, 200);
+			auto few_dynamic = dynamic_time_frontier(*few, 200);
+			for (int b = 0; b <= 200; b++)
+			{
+				TEST_LT("few rides", std::fabs(few_exhaustive[b] - few_dynamic[b]), 1e-6);
+			}
+			auto trivial = exhaustive_time_frontier(trivial_rides, 30);
+			TEST_EQUAL("speedway only", 5.0, trivial[4]);
+			TEST_EQUAL("ferris wheel", 20.0, trivial[10]);
+			TEST_EQUAL("both", 25.0, trivial[14]);
+			TEST_TRUE("negative budget", exhaustive_time_frontier(trivial_rides, -1).empty());
+		}
+	);
+
 	return rubric.run();
 }
@@ -0,0 +1,394 @@
+///////////////////////////////////////////////////////////////////////////////
+// monte_carlo.hh
+//
+// Score ride selections under random queue waits.
+//
+// sum_ride_vector gives a plan one total time, but every ride also has a
+// queue, so what a plan is worth is a distribution. A MonteCarloEvaluator
+// samples scenarios: in scenario s, ride i takes its time plus an
+// exponentially distributed wait with that ride's mean. Each plan's total is
+// computed in every scenario, and the distribution is summarized by its mean,
+// standard deviation and percentiles.
+//
+// The waits come from Philox4x32-10, a counter-based generator: the wait of
+// ride i in scenario s is a pure function of (seed, s, i). Scenarios can then
+// be split across threads in any way and give the same results, and every
+// plan sees the same waits in the same scenario (common random numbers), so
+// the differences between plans are not blurred by sampling noise. The
+// generator runs on arrays of counters in a MAXTIME_KERNEL loop, which the
+// AVX2 and AVX-512 clones vectorize.
+//
+// sample_average_plan is sample average approximation: it averages each
+// ride's sampled total over the scenarios and runs dynamic_select on those
+// averages. Since a plan's total is a sum over its rides, that maximizes the
+// plan's mean total over the sampled scenarios. Plan totals do not depend on
+// the number of threads; the averages can differ in the last bits with it.
+//
+// How to use:
+//
+//    std::vector<double> mean_waits(rides->size(), 15.0);
+//    MonteCarloEvaluator evaluator(*rides, mean_waits, 10000, 42);
+//    auto plan = evaluator.sample_average_plan(500);
+//    auto spread = evaluator.evaluate({ plan })[0];
+//    // spread.percentiles[2] is the median total time of the plan
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+
+#include "isa.hh"
+#include "maxtime.hh"
+#include "parallel_report.hh"
+#include "workspace.hh"
+
+
+// Philox4x32-10 of counters (c0[k], c1[k], c2, c3) under key (k0, k1), for k = 0 .. n - 1;
+// writes the four output words to out0 .. out3.
+MAXTIME_KERNEL
+inline void philox4x32_10
+(
+	const uint32_t* c0,
+	const uint32_t* c1,
+	uint32_t c2,
+	uint32_t c3,
+	uint32_t k0,
+	uint32_t k1,
+	size_t n,
+	uint32_t* out0,
+	uint32_t* out1,
+	uint32_t* out2,
+	uint32_t* out3
+)
+{
+	const uint64_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+	const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+	// a block of 64 counters at a time through local arrays, which cannot alias the
+	// outputs, so the rounds vectorize across the block
+	for (size_t first = 0; first < n; first += 64)
+	{
+		size_t count = std::min<size_t>(64, n - first);
+		uint32_t in0[64] = { }, in1[64] = { }, lane0[64], lane1[64], lane2[64], lane3[64];
+		std::copy(c0 + first, c0 + first + count, in0);
+		std::copy(c1 + first, c1 + first + count, in1);
+		for (size_t k = 0; k < 64; k++)
+		{
+			uint32_t x0 = in0[k], x1 = in1[k], x2 = c2, x3 = c3, key0 = k0, key1 = k1;
+			for (int round = 0; round < 10; round++)
+			{
+				uint64_t product0 = M0 * x0, product1 = M1 * x2;
+				uint32_t y0 = uint32_t(product1 >> 32) ^ x1 ^ key0;
+				uint32_t y2 = uint32_t(product0 >> 32) ^ x3 ^ key1;
+				x1 = uint32_t(product1);
+				x3 = uint32_t(product0);
+				x0 = y0;
+				x2 = y2;
+				key0 += W0;
+				key1 += W1;
+			}
+			lane0[k] = x0;
+			lane1[k] = x1;
+			lane2[k] = x2;
+			lane3[k] = x3;
+		}
+		std::copy(lane0, lane0 + count, out0 + first);
+		std::copy(lane1, lane1 + count, out1 + first);
+		std::copy(lane2, lane2 + count, out2 + first);
+		std::copy(lane3, lane3 + count, out3 + first);
+	}
+}
+
+
+// Summary of one plan's total time over the scenarios.
+struct PlanDistribution
+{
+	double mean;
+	double stddev;
+	double min;
+	double max;
+
+	// One per requested percentile, in the same order.
+	std::vector<double> percentiles;
+};
+
+
+// Samples wait scenarios over a ride vector and scores plans in them; see the top of this file.
+class MonteCarloEvaluator
+{
+	//
+	public:
+
+		// mean_waits[i] is ride i's mean wait in minutes (0 for none). threads splits the
+		// scenarios; 0 means one per hardware thread. percentile_levels are in [0, 100].
+		// If report is not null, each pass over the scenarios is added to it as a
+		// "monte carlo scenarios" phase.
+		MonteCarloEvaluator
+		(
+			const RideVector& rides,
+			const std::vector<double>& mean_waits,
+			size_t scenarios,
+			uint64_t seed,
+			size_t threads = 0,
+			const std::vector<double>& percentile_levels = { 5, 25, 50, 75, 95 },
+			ParallelReport* report = nullptr
+		)
+			:
+			_rides(rides),
+			_mean_waits(mean_waits),
+			_scenarios(scenarios),
+			_seed(seed),
+			_threads(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+			_levels(percentile_levels),
+			_report(report)
+		{
+			assert(mean_waits.size() == rides.size());
+			assert(scenarios > 0 && scenarios < (uint64_t(1) << 32));
+		}
+
+		// Number of scenarios sampled.
+		size_t scenarios() const { return _scenarios; }
+
+		// Wait of each of the rides in scenario s, in the order given.
+		std::vector<double> waits(size_t s, const std::vector<size_t>& rides) const
+		{
+			std::vector<double> result(rides.size());
+			WaitSampler sampler(*this, rides);
+			sampler.sample(s, result.data());
+			return result;
+		}
+
+		// Distribution of each plan's total time, ride times plus waits; a plan lists ride
+		// indices, each at most once.
+		std::vector<PlanDistribution> evaluate(const std::vector<std::vector<size_t>>& plans) const
+		{
+			// the rides used by any plan, and each plan as positions among them
+			std::vector<size_t> used;
+			for (const std::vector<size_t>& plan : plans)
+			{
+				used.insert(used.end(), plan.begin(), plan.end());
+			}
+			std::sort(used.begin(), used.end());
+			used.erase(std::unique(used.begin(), used.end()), used.end());
+
+			std::vector<std::vector<size_t>> positions(plans.size());
+			std::vector<double> base(plans.size(), 0);
+			for (size_t p = 0; p < plans.size(); p++)
+			{
+				for (size_t i : plans[p])
+				{
+					positions[p].push_back(std::lower_bound(used.begin(), used.end(), i) - used.begin());
+					base[p] += _rides[i]->time();
+				}
+			}
+
+			// totals[p * scenarios + s]
+			std::vector<double> totals(plans.size() * _scenarios);
+			in_parallel([&](size_t, size_t first, size_t end)
+			{
+				WaitSampler sampler(*this, used);
+				std::vector<double> sampled(used.size());
+				for (size_t s = first; s < end; s++)
+				{
+					sampler.sample(s, sampled.data());
+					for (size_t p = 0; p < plans.size(); p++)
+					{
+						double total = base[p];
+						for (size_t k : positions[p])
+						{
+							total += sampled[k];
+						}
+						totals[p * _scenarios + s] = total;
+					}
+				}
+			});
+
+			std::vector<PlanDistribution> distributions;
+			for (size_t p = 0; p < plans.size(); p++)
+			{
+				distributions.push_back(summarize(totals.data() + p * _scenarios));
+			}
+			return distributions;
+		}
+
+		// Sample average approximation: the plan within total_cost whose mean total time over
+		// the sampled scenarios is greatest, as ride indices in increasing order.
+		std::vector<size_t> sample_average_plan(int total_cost) const
+		{
+			size_t n = _rides.size();
+			std::vector<size_t> all(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				all[i] = i;
+			}
+
+			// each thread sums its scenarios' waits; the sums are added in thread order
+			std::vector<std::vector<double>> sums(_threads, std::vector<double>(n, 0));
+			in_parallel([&](size_t t, size_t first, size_t end)
+			{
+				std::vector<double>& sum = sums[t];
+				WaitSampler sampler(*this, all);
+				std::vector<double> sampled(n);
+				for (size_t s = first; s < end; s++)
+				{
+					sampler.sample(s, sampled.data());
+					for (size_t i = 0; i < n; i++)
+					{
+						sum[i] += sampled[i];
+					}
+				}
+			});
+
+			SolverWorkspace& workspace = thread_workspace();
+			SolverWorkspace::Frame frame(workspace);
+			int* costs = workspace.borrow<int>(n);
+			double* times = workspace.borrow<double>(n);
+			size_t* selected = workspace.borrow<size_t>(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				double waited = 0;
+				for (const std::vector<double>& sum : sums)
+				{
+					waited += sum[i];
+				}
+				costs[i] = _rides[i]->cost();
+				times[i] = _rides[i]->time() + waited / _scenarios;
+			}
+			size_t count = dynamic_select(costs, times, n, total_cost, selected, workspace);
+
+			std::vector<size_t> plan(selected, selected + count);
+			std::sort(plan.begin(), plan.end());
+			return plan;
+		}
+
+	//
+	private:
+
+		// Draws the waits of a fixed list of rides, one scenario at a time.
+		// Ride i's wait in scenario s is lane i % 4 of Philox block (i / 4, 0, s, 0).
+		class WaitSampler
+		{
+			//
+			public:
+
+				//
+				WaitSampler(const MonteCarloEvaluator& evaluator, const std::vector<size_t>& rides)
+					:
+					_evaluator(evaluator),
+					_rides(rides)
+				{
+					for (size_t i : rides)
+					{
+						_blocks.push_back(uint32_t(i / 4));
+					}
+					std::sort(_blocks.begin(), _blocks.end());
+					_blocks.erase(std::unique(_blocks.begin(), _blocks.end()), _blocks.end());
+					for (size_t i : rides)
+					{
+						_block_of.push_back(std::lower_bound(_blocks.begin(), _blocks.end(), uint32_t(i / 4)) - _blocks.begin());
+					}
+					_zeros.assign(_blocks.size(), 0);
+					for (auto& lane : _lanes)
+					{
+						lane.resize(_blocks.size());
+					}
+				}
+
+				// waits[k] = wait of rides[k] in scenario s.
+				void sample(size_t s, double* waits)
+				{
+					philox4x32_10(_blocks.data(), _zeros.data(), uint32_t(s), 0,
+						uint32_t(_evaluator._seed), uint32_t(_evaluator._seed >> 32), _blocks.size(),
+						_lanes[0].data(), _lanes[1].data(), _lanes[2].data(), _lanes[3].data());
+
+					for (size_t k = 0; k < _rides.size(); k++)
+					{
+						size_t i = _rides[k], block = _block_of[k];
+						// uniform in (0, 1), never 0, then the inverse of the exponential CDF
+						double uniform = (_lanes[i % 4][block] + 0.5) * (1.0 / 4294967296.0);
+						waits[k] = -_evaluator._mean_waits[i] * std::log(uniform);
+					}
+				}
+
+			//
+			private:
+
+				const MonteCarloEvaluator& _evaluator;
+				const std::vector<size_t>& _rides;
+				std::vector<uint32_t> _blocks, _zeros;
+				std::vector<size_t> _block_of;
+				std::vector<uint32_t> _lanes[4];
+		};
+
+		// Run body(t, first, end) for each thread t over contiguous ranges of scenarios.
+		template <typename Body>
+		void in_parallel(Body body) const
+		{
+			size_t threads = std::min(_threads, _scenarios);
+			size_t chunk = (_scenarios + threads - 1) / threads;
+			ParallelPhase phase(_report, "monte carlo scenarios", threads);
+			auto worker = [&body, &phase](size_t t, size_t first, size_t end)
+			{
+				ThreadCpuTimer cpu;
+				body(t, first, end);
+				phase.record_thread(t, cpu.elapsed());
+			};
+			std::vector<std::thread> pool;
+			for (size_t t = 1; t < threads; t++)
+			{
+				pool.emplace_back(worker, t, std::min(_scenarios, t * chunk), std::min(_scenarios, (t + 1) * chunk));
+			}
+			worker(0, 0, std::min(_scenarios, chunk));
+			for (std::thread& thread : pool)
+			{
+				thread.join();
+			}
+		}
+
+		// Mean, spread and percentiles of the totals of one plan; linear interpolation
+		// between order statistics.
+		PlanDistribution summarize(double* totals) const
+		{
+			PlanDistribution distribution;
+			double sum = 0, squares = 0;
+			for (size_t s = 0; s < _scenarios; s++)
+			{
+				sum += totals[s];
+			}
+			distribution.mean = sum / _scenarios;
+			for (size_t s = 0; s < _scenarios; s++)
+			{
+				squares += (totals[s] - distribution.mean) * (totals[s] - distribution.mean);
+			}
+			distribution.stddev = _scenarios > 1 ? std::sqrt(squares / (_scenarios - 1)) : 0;
+
+			std::sort(totals, totals + _scenarios);
+			distribution.min = totals[0];
+			distribution.max = totals[_scenarios - 1];
+			for (double level : _levels)
+			{
+				double rank = std::min(100.0, std::max(0.0, level)) / 100 * (_scenarios - 1);
+				size_t below = size_t(rank);
+				size_t above = std::min(below + 1, _scenarios - 1);
+				distribution.percentiles.push_back(totals[below] + (rank - below) * (totals[above] - totals[below]));
+			}
+			return distribution;
+		}
+
+		const RideVector& _rides;
+		std::vector<double> _mean_waits;
+		size_t _scenarios;
+		uint64_t _seed;
+		size_t _threads;
+		std::vector<double> _levels;
+		ParallelReport* _report;
+};
@@ -0,0 +1,268 @@
+///////////////////////////////////////////////////////////////////////////////
+// orderings.hh
+//
+// Sorted orders of a ride vector, computed once and shared by the engines.
+//
+// The greedy and LP bounds, the reduction, branch-and-bound and the conflict
+// search all want the rides by decreasing time per dollar; the frontier also
+// wants them by cost, and the longest-rides filter by time. A RideOrderings
+// holds these permutations for one RideVector. Each is built the first time
+// it is asked for, by a parallel LSD radix sort on 64-bit keys, and is then
+// reused by every engine given the same RideOrderings. RideCatalog keeps one
+// per version, so a new version starts with none built.
+//
+// How to use:
+//
+//    RideOrderings orderings(*rides);
+//    auto bound = TimeFrontier(*rides, &orderings);
+//    auto best = reduced_dynamic_max_time(*rides, 500, &orderings);
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+
+#include "maxtime.hh"
+#include "parallel_report.hh"
+
+
+// Key whose unsigned order is the order of value, for any double but NaN.
+// -0.0 and 0.0 get the same key, as they compare equal.
+inline uint64_t ordered_key(double value)
+{
+	uint64_t bits;
+	value = value == 0 ? 0.0 : value;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return (bits >> 63) != 0 ? ~bits : bits | (uint64_t(1) << 63);
+}
+
+
+// Set order to the indices 0 .. keys.size() - 1 sorted by increasing key; equal keys keep
+// index order. An LSD radix sort, one byte per pass, skipping bytes that are the same in
+// every key. Each pass counts and scatters in threads parallel chunks. If report is not
+// null, the count and scatter phases of the passes are added to it.
+inline void radix_sort_indices
+(
+	const std::vector<uint64_t>& keys,
+	std::vector<size_t>& order,
+	size_t threads,
+	ParallelReport* report = nullptr
+)
+{
+	size_t n = keys.size();
+	order.resize(n);
+	std::iota(order.begin(), order.end(), 0);
+	if (n < 2)
+	{
+		return;
+	}
+
+	uint64_t varies = 0;
+	for (uint64_t key : keys)
+	{
+		varies |= key ^ keys[0];
+	}
+
+	threads = std::max<size_t>(1, std::min(threads, n));
+	size_t chunk = (n + threads - 1) / threads;
+	auto in_parallel = [&](const char* name, auto body)
+	{
+		ParallelPhase phase(report, name, threads);
+		auto timed = [&](size_t t)
+		{
+			ThreadCpuTimer cpu;
+			body(t);
+			phase.record_thread(t, cpu.elapsed());
+		};
+		std::vector<std::thread> pool;
+		for (size_t t = 1; t < threads; t++)
+		{
+			pool.emplace_back(timed, t);
+		}
+		timed(0);
+		for (std::thread& thread : pool)
+		{
+			thread.join();
+		}
+	};
+
+	std::vector<uint64_t> sorted_keys(keys), key_buffer(n);
+	std::vector<size_t> order_buffer(n);
+	std::vector<std::array<size_t, 256>> offsets(threads);
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		if (((varies >> shift) & 0xff) == 0)
+		{
+			continue;
+		}
+
+		in_parallel("radix count", [&](size_t t)
+		{
+			std::array<size_t, 256>& count = offsets[t];
+			count.fill(0);
+			for (size_t k = t * chunk; k < std::min(n, (t + 1) * chunk); k++)
+			{
+				count[(sorted_keys[k] >> shift) & 0xff]++;
+			}
+		});
+
+		// chunk t's run of digit d starts after all smaller digits, and after digit d of earlier chunks
+		size_t start = 0;
+		for (size_t digit = 0; digit < 256; digit++)
+		{
+			for (size_t t = 0; t < threads; t++)
+			{
+				size_t count = offsets[t][digit];
+				offsets[t][digit] = start;
+				start += count;
+			}
+		}
+
+		in_parallel("radix scatter", [&](size_t t)
+		{
+			std::array<size_t, 256>& next = offsets[t];
+			for (size_t k = t * chunk; k < std::min(n, (t + 1) * chunk); k++)
+			{
+				size_t to = next[(sorted_keys[k] >> shift) & 0xff]++;
+				key_buffer[to] = sorted_keys[k];
+				order_buffer[to] = order[k];
+			}
+		});
+
+		sorted_keys.swap(key_buffer);
+		order.swap(order_buffer);
+	}
+}
+
+
+// Permutations of one ride vector by ratio, cost and time; see the top of this file.
+// Safe to share between threads.
+class RideOrderings
+{
+	//
+	public:
+
+		// threads sorts each ordering in parallel; 0 means one per hardware thread, if
+		// there are enough rides to be worth it.
+		explicit RideOrderings(const RideVector& rides, size_t threads = 0)
+			:
+			_costs(rides.size()),
+			_times(rides.size()),
+			_threads(threads),
+			_sorts(0)
+		{
+			for (size_t i = 0; i < rides.size(); i++)
+			{
+				_costs[i] = rides[i]->cost();
+				_times[i] = rides[i]->time();
+			}
+
+			// threads only pay off with at least this many rides each
+			const size_t MIN_CHUNK = 16384;
+			if (_threads == 0)
+			{
+				_threads = std::min<size_t>(std::thread::hardware_concurrency(), rides.size() / MIN_CHUNK);
+			}
+		}
+
+		// Number of rides ordered.
+		size_t size() const { return _costs.size(); }
+
+		// Rides by decreasing time per dollar; ties keep index order.
+		const std::vector<size_t>& by_ratio() const
+		{
+			return ordering(RATIO, [&](size_t i) { return ~ordered_key(_times[i] / _costs[i]); });
+		}
+
+		// Rides by increasing cost; ties keep index order.
+		const std::vector<size_t>& by_cost() const
+		{
+			return ordering(COST, [&](size_t i) { return uint64_t(uint32_t(_costs[i]) ^ 0x80000000u); });
+		}
+
+		// Rides by decreasing time; ties keep index order.
+		const std::vector<size_t>& by_time() const
+		{
+			return ordering(TIME, [&](size_t i) { return ~ordered_key(_times[i]); });
+		}
+
+		// Number of orderings sorted so far; each is sorted at most once.
+		size_t sorts() const { return _sorts.load(); }
+
+	//
+	private:
+
+		enum Kind { RATIO, COST, TIME, KINDS };
+
+		template <typename Key>
+		const std::vector<size_t>& ordering(Kind kind, Key key) const
+		{
+			std::call_once(_built[kind], [&]()
+			{
+				std::vector<uint64_t> keys(size());
+				for (size_t i = 0; i < size(); i++)
+				{
+					keys[i] = key(i);
+				}
+				radix_sort_indices(keys, _orders[kind], _threads);
+				_sorts.fetch_add(1);
+			});
+			return _orders[kind];
+		}
+
+		std::vector<int> _costs;
+		std::vector<double> _times;
+		size_t _threads;
+		mutable std::once_flag _built[KINDS];
+		mutable std::vector<size_t> _orders[KINDS];
+		mutable std::atomic<size_t> _sorts;
+};
+
+
+// filter_ride_vector(source, min_time, max_time, total_size, FILTER_LONGEST), walking
+// orderings.by_time() instead of scanning and selecting: O(total_size + longer rides skipped).
+inline std::unique_ptr<RideVector> filter_ride_vector
+(
+	const RideVector& source,
+	double min_time,
+	double max_time,
+	int total_size,
+	const RideOrderings& orderings
+)
+{
+	assert(orderings.size() == source.size());
+
+	std::unique_ptr<RideVector> longest(new RideVector);
+	for (size_t i : orderings.by_time())
+	{
+		if (int((*longest).size()) >= total_size)
+		{
+			break;
+		}
+		double time = source[i]->time();
+		if (time <= 0 || time < min_time)
+		{
+			break;
+		}
+		if (time <= max_time)
+		{
+			(*longest).push_back(source[i]);
+		}
+	}
+	return longest;
+}
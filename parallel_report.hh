@@ -0,0 +1,278 @@
+///////////////////////////////////////////////////////////////////////////////
+// parallel_report.hh
+//
+// CPU time of threads and reports of the parallel phases of the solvers.
+//
+// ThreadCpuTimer, resource_usage() and ParallelReport add CPU time to the
+// wall time of Timer, so that parallel phases can be judged by how busy
+// their threads were. A phase of t threads taking wall time W reports:
+//
+//    cpu         the sum of its threads' CPU time
+//    speedup     cpu / W, the serial time the work would have taken
+//    efficiency  speedup / t
+//    wait        the sum over threads of W - their CPU time: time
+//                blocked at joins, on locks, or descheduled
+//    spin        CPU time threads reported burning while out of work,
+//                which counts as cpu but is not useful work
+//
+// CPU time comes from POSIX clock_gettime(CLOCK_THREAD_CPUTIME_ID) and
+// getrusage. Elsewhere, MAXTIME_CPU_TIMES is 0 and CPU times and context
+// switches read as zero, so reports keep their wall times only.
+//
+// How to use:
+//
+//    ParallelReport report;
+//    {
+//        ParallelPhase phase(&report, "search", threads);
+//        // on each thread t: ThreadCpuTimer cpu; ...; phase.record_thread(t, cpu.elapsed());
+//    }
+//    report.write(std::cerr);
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAXTIME_CPU_TIMES 1
+#include <sys/resource.h>
+#include <time.h>
+#else
+#define MAXTIME_CPU_TIMES 0
+#endif
+
+
+#include "timer.hh"
+
+
+// Timer for the CPU time of the calling thread.
+class ThreadCpuTimer
+{
+	//
+	public:
+
+		// Create a new timer that is running as soon as it is created.
+		ThreadCpuTimer()
+		{
+			reset();
+		}
+
+		// Reset the timer.
+		void reset()
+		{
+			_start = now();
+		}
+
+		// Return the CPU seconds the calling thread has used since the timer
+		// was created or reset; must be called on the thread that created it.
+		double elapsed() const
+		{
+			return now() - _start;
+		}
+
+		// CPU seconds used by the calling thread since it started.
+		static double now()
+		{
+#if MAXTIME_CPU_TIMES
+			timespec ts;
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+			return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+			return 0;
+#endif
+		}
+
+	//
+	private:
+
+		double _start;
+};
+
+
+// CPU time and context switches of the whole process so far.
+struct ResourceUsage
+{
+	double user_seconds;
+	double system_seconds;
+	long voluntary_switches;
+	long involuntary_switches;
+};
+
+inline ResourceUsage resource_usage()
+{
+#if MAXTIME_CPU_TIMES
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return ResourceUsage{
+		usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6,
+		usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6,
+		usage.ru_nvcsw,
+		usage.ru_nivcsw
+	};
+#else
+	return ResourceUsage{ 0, 0, 0, 0 };
+#endif
+}
+
+
+// Wall and CPU time of the phases of parallel solvers; see the top of
+// this file. Phases with the same name, such as the passes of a sort,
+// are added together. Safe to share between threads.
+class ParallelReport
+{
+	//
+	public:
+
+		// Totals for one named phase.
+		struct Phase
+		{
+			std::string name;
+			size_t threads = 0;
+			size_t runs = 0;
+			double wall = 0;
+			double cpu = 0;
+			double wait = 0;
+			double spin = 0;
+			double process_cpu = 0;
+			long voluntary_switches = 0;
+			long involuntary_switches = 0;
+
+			double speedup() const { return wall > 0 ? cpu / wall : 0; }
+			double efficiency() const { return threads > 0 ? speedup() / threads : 0; }
+		};
+
+		// Add a finished run of a phase.
+		void add(const Phase& run)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (Phase& phase : _phases)
+			{
+				if (phase.name == run.name)
+				{
+					phase.threads = std::max(phase.threads, run.threads);
+					phase.runs += run.runs;
+					phase.wall += run.wall;
+					phase.cpu += run.cpu;
+					phase.wait += run.wait;
+					phase.spin += run.spin;
+					phase.process_cpu += run.process_cpu;
+					phase.voluntary_switches += run.voluntary_switches;
+					phase.involuntary_switches += run.involuntary_switches;
+					return;
+				}
+			}
+			_phases.push_back(run);
+		}
+
+		// The phases in the order first seen.
+		std::vector<Phase> phases() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _phases;
+		}
+
+		// One line per phase.
+		void write(std::ostream& out) const
+		{
+			out << std::left << std::setw(24) << "phase" << std::right
+				<< std::setw(8) << "threads" << std::setw(12) << "wall ms" << std::setw(12) << "cpu ms"
+				<< std::setw(9) << "speedup" << std::setw(11) << "efficiency" << std::setw(12) << "wait ms"
+				<< std::setw(12) << "spin ms" << std::setw(10) << "switches" << std::endl;
+			for (const Phase& phase : phases())
+			{
+				out << std::left << std::setw(24) << phase.name << std::right
+					<< std::setw(8) << phase.threads << std::setw(12) << phase.wall * 1e3 << std::setw(12) << phase.cpu * 1e3
+					<< std::setw(9) << phase.speedup() << std::setw(11) << phase.efficiency() << std::setw(12) << phase.wait * 1e3
+					<< std::setw(12) << phase.spin * 1e3
+					<< std::setw(10) << phase.voluntary_switches + phase.involuntary_switches << std::endl;
+			}
+		}
+
+	//
+	private:
+
+		mutable std::mutex _mutex;
+		std::vector<Phase> _phases;
+};
+
+
+// One run of a parallel phase, added to a report (if not null) when it
+// is destroyed. Each of its threads calls record_thread once, with a
+// ThreadCpuTimer it started when it began.
+class ParallelPhase
+{
+	//
+	public:
+
+		ParallelPhase(ParallelReport* report, const std::string& name, size_t threads)
+			:
+			_report(report),
+			_name(name),
+			_threads(threads),
+			_cpu(threads, 0),
+			_spin(threads, 0)
+		{
+			if (_report != nullptr)
+			{
+				_usage = resource_usage();
+			}
+		}
+
+		ParallelPhase(const ParallelPhase&) = delete;
+		ParallelPhase& operator=(const ParallelPhase&) = delete;
+
+		// Record that thread t of the phase used cpu_seconds, of which
+		// spin_seconds went on waiting for work.
+		void record_thread(size_t t, double cpu_seconds, double spin_seconds = 0)
+		{
+			assert(t < _threads);
+			_cpu[t] = cpu_seconds;
+			_spin[t] = spin_seconds;
+		}
+
+		~ParallelPhase()
+		{
+			if (_report == nullptr)
+			{
+				return;
+			}
+			double wall = _timer.elapsed();
+			ResourceUsage usage = resource_usage();
+
+			ParallelReport::Phase run;
+			run.name = _name;
+			run.threads = _threads;
+			run.runs = 1;
+			run.wall = wall;
+			for (size_t t = 0; t < _threads; t++)
+			{
+				run.cpu += _cpu[t];
+				run.wait += std::max(0.0, wall - _cpu[t]);
+				run.spin += _spin[t];
+			}
+			run.process_cpu = usage.user_seconds + usage.system_seconds - _usage.user_seconds - _usage.system_seconds;
+			run.voluntary_switches = usage.voluntary_switches - _usage.voluntary_switches;
+			run.involuntary_switches = usage.involuntary_switches - _usage.involuntary_switches;
+			_report->add(run);
+		}
+
+	//
+	private:
+
+		ParallelReport* _report;
+		std::string _name;
+		size_t _threads;
+		std::vector<double> _cpu, _spin;
+		ResourceUsage _usage;
+		Timer _timer;
+};
@@ -0,0 +1,204 @@
+///////////////////////////////////////////////////////////////////////////////
+// reachable.hh
+//
+// Dynamic algorithm over reachable costs only.
+//
+// Most budget columns of the dynamic_max_time table are dollar amounts that no
+// selection of rides spends exactly; their cells just repeat the column to
+// their left. A bitset subset-sum pass first finds the reachable totals, and
+// the dynamic algorithm then runs over that compressed list of costs, keeping
+// the best time that spends exactly each reachable amount. A query for a
+// budget maps back to the best among the reachable amounts within it. When
+// ride costs are coarse (e.g. all multiples of 5) or the rides are few, the
+// table shrinks by the same factor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+
+#include "maxtime.hh"
+#include "workspace.hh"
+
+
+// Mark in reachable (total_cost + 1 bits) every total of a selection of the rides
+// that fits within total_cost. Returns how many totals are reachable, none if total_cost
+// is negative, when reachable is not touched.
+inline size_t reachable_costs
+(
+	const int* costs,
+	size_t n,
+	int total_cost,
+	uint64_t* reachable
+)
+{
+	if (total_cost < 0)
+	{
+		return 0;
+	}
+
+	size_t width = size_t(total_cost) + 1;
+	size_t words = (width + 63) / 64;
+	std::fill(reachable, reachable + words, 0);
+	reachable[0] = 1;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t cost = costs[i];
+		if (cost > size_t(total_cost))
+		{
+			continue;
+		}
+
+		// reachable |= reachable << cost, from the high words down so each
+		// source word is read before it is overwritten
+		size_t word_shift = cost / 64, bit_shift = cost % 64;
+		for (size_t w = words; w-- > word_shift; )
+		{
+			uint64_t shifted = reachable[w - word_shift] << bit_shift;
+			if (bit_shift != 0 && w > word_shift)
+			{
+				shifted |= reachable[w - word_shift - 1] >> (64 - bit_shift);
+			}
+			reachable[w] |= shifted;
+		}
+	}
+
+	// clear the bits past total_cost in the last word
+	if (width % 64 != 0)
+	{
+		reachable[words - 1] &= (uint64_t(1) << (width % 64)) - 1;
+	}
+
+	size_t count = 0;
+	for (size_t w = 0; w < words; w++)
+	{
+		count += __builtin_popcountll(reachable[w]);
+	}
+	return count;
+}
+
+
+// Dynamic algorithm over n rides given as flat cost and time arrays, with the table
+// spanning only reachable totals. Same contract as dynamic_select.
+inline size_t compressed_dynamic_select
+(
+	const int* costs,
+	const double* times,
+	size_t n,
+	int total_cost,
+	size_t* selected,
+	SolverWorkspace& workspace
+)
+{
+	if (total_cost < 0)
+	{
+		return 0;
+	}
+
+	SolverWorkspace::Frame frame(workspace);
+
+	size_t width = size_t(total_cost) + 1;
+	uint64_t* reachable = workspace.borrow<uint64_t>((width + 63) / 64);
+	size_t m = reachable_costs(costs, n, total_cost, reachable);
+
+	// amounts[r] is the r-th reachable total; column[s] maps a total back to r, or -1
+	int* amounts = workspace.borrow<int>(m);
+	int* column = workspace.borrow<int>(width);
+	for (size_t s = 0, r = 0; s < width; s++)
+	{
+		if ((reachable[s / 64] >> (s % 64)) & 1)
+		{
+			amounts[r] = s;
+			column[s] = r++;
+		}
+		else
+		{
+			column[s] = -1;
+		}
+	}
+
+	// best[r] is the best time spending exactly amounts[r]; updated in place from
+	// the largest amount down, so best[] still holds the previous ride's row where it is read
+	const double unreachable = -std::numeric_limits<double>::infinity();
+	size_t words = (m + 63) / 64;
+	double* best = workspace.borrow<double>(m);
+	uint64_t* taken = workspace.borrow_zeroed<uint64_t>(n * words);
+	best[0] = 0;
+	std::fill(best + 1, best + m, unreachable);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		int cost = costs[i];
+		double time = times[i];
+		if (cost > total_cost || !(time > 0))
+		{
+			continue;
+		}
+		uint64_t* bits = taken + i * words;
+		for (size_t r = m; r-- > 0 && amounts[r] >= cost; )
+		{
+			int from = column[amounts[r] - cost];
+			if (from >= 0 && best[from] + time > best[r])
+			{
+				best[r] = best[from] + time;
+				bits[r / 64] |= uint64_t(1) << (r % 64);
+			}
+		}
+	}
+
+	// map the budget back: the best over all reachable amounts within it
+	size_t answer = 0;
+	for (size_t r = 1; r < m; r++)
+	{
+		if (best[r] > best[answer])
+		{
+			answer = r;
+		}
+	}
+
+	size_t count = 0;
+	for (size_t i = n; i > 0; i--)
+	{
+		if ((taken[(i - 1) * words + answer / 64] >> (answer % 64)) & 1)
+		{
+			selected[count++] = i - 1;
+			answer = column[amounts[answer] - costs[i - 1]];
+		}
+	}
+	return count;
+}
+
+
+// Compute the optimal set of ride items with the dynamic algorithm over reachable costs.
+// Same answer value as dynamic_max_time.
+inline std::unique_ptr<RideVector> compressed_dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost
+)
+{
+	std::unique_ptr<RideVector> best1(new RideVector);
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+
+	int* costs;
+	double* times;
+	gather_ride_columns(rides, workspace, costs, times);
+	size_t* selected = workspace.borrow<size_t>(rides.size());
+
+	size_t count = compressed_dynamic_select(costs, times, rides.size(), total_cost, selected, workspace);
+
+	(*best1).reserve(count);
+	for (size_t k = 0; k < count; k++)
+	{
+		(*best1).push_back(rides[selected[k]]);
+	}
+	return best1;
+}
@@ -0,0 +1,373 @@
+///////////////////////////////////////////////////////////////////////////////
+// reduction.hh
+//
+// Shrink a ride selection problem before solving it exactly.
+//
+// Using the LP bounds from bounds.hh (the Martello-Toth reduction), many rides
+// can be proven to be in every optimal selection, or in none. Those rides are
+// fixed, their cost is taken out of the budget, and only the undecided rides
+// are handed to dynamic_max_time or exhaustive_max_time. The fixed rides are
+// then merged back into the answer.
+//
+// Guests' own constraints are applied the same way: rides they pin are fixed
+// and rides they ban are dropped before solving.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+
+#include "bounds.hh"
+#include "maxtime.hh"
+#include "orderings.hh"
+#include "workspace.hh"
+
+
+// A ride selection problem split into rides already decided and rides left to solve.
+struct RideReduction
+{
+	// Rides that belong in the answer; their cost is already taken out of free_budget.
+	RideVector fixed;
+
+	// Rides still undecided, in their original order.
+	RideVector free;
+
+	// Budget left for the free rides.
+	int free_budget;
+};
+
+
+// LP bound over the ratio-sorted rides, skipping the ride at position skip,
+// with the given capacity. prefix_costs and prefix_times hold the sums of the
+// first k sorted rides, for k = 0 .. m. O(log m).
+inline double lp_bound_without
+(
+	const int* costs,
+	const double* times,
+	const size_t* order,
+	const long* prefix_costs,
+	const double* prefix_times,
+	size_t m,
+	size_t skip,
+	long capacity
+)
+{
+	if (capacity < 0)
+	{
+		return -1;
+	}
+
+	long skip_cost = costs[order[skip]];
+	double skip_time = times[order[skip]];
+	auto cost_of = [&](size_t k) { return prefix_costs[k] - (k > skip ? skip_cost : 0); };
+
+	// largest k whose prefix, without the skipped ride, fits
+	size_t lo = 0, hi = m;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo + 1) / 2;
+		if (cost_of(mid) <= capacity)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+
+	size_t k = lo;
+	double bound = prefix_times[k] - (k > skip ? skip_time : 0);
+	size_t next = (k == skip) ? k + 1 : k;
+	if (next < m)
+	{
+		bound += times[order[next]] * (capacity - cost_of(k)) / costs[order[next]];
+	}
+	return bound;
+}
+
+
+// Number of rides on each side of the critical ride solved exactly for the incumbent.
+const size_t CORE_RADIUS = 32;
+
+
+// Fix every ride that LP bounds prove to be in all optimal selections within total_cost,
+// and drop every ride proven to be in none. Rides with no positive time, or that cost more
+// than the whole budget, are always dropped. O(n log n).
+// orderings, if given, must be for rides; its ratio order is used instead of sorting.
+inline RideReduction reduce_rides
+(
+	const RideVector& rides,
+	int total_cost,
+	const RideOrderings* orderings = nullptr
+)
+{
+	RideReduction reduction;
+	reduction.free_budget = total_cost;
+
+	SolverWorkspace& workspace = thread_workspace();
+	SolverWorkspace::Frame frame(workspace);
+
+	int* costs;
+	double* times;
+	gather_ride_columns(rides, workspace, costs, times);
+
+	// candidates sorted by decreasing time per dollar
+	size_t* order = workspace.borrow<size_t>(rides.size());
+	size_t m = 0;
+	if (orderings != nullptr)
+	{
+		assert(orderings->size() == rides.size());
+		for (size_t i : orderings->by_ratio())
+		{
+			if (times[i] > 0 && costs[i] <= total_cost)
+			{
+				order[m++] = i;
+			}
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < rides.size(); i++)
+		{
+			if (times[i] > 0 && costs[i] <= total_cost)
+			{
+				order[m++] = i;
+			}
+		}
+		RideRatioGreater greater = { costs, times };
+		std::sort(order, order + m, greater);
+	}
+
+	long* prefix_costs = workspace.borrow<long>(m + 1);
+	double* prefix_times = workspace.borrow<double>(m + 1);
+	prefix_costs[0] = 0;
+	prefix_times[0] = 0;
+	for (size_t k = 0; k < m; k++)
+	{
+		prefix_costs[k + 1] = prefix_costs[k] + costs[order[k]];
+		prefix_times[k + 1] = prefix_times[k] + times[order[k]];
+	}
+
+	// incumbent: greedy over the whole sorted list, or the best single ride
+	double lower = 0, greedy = 0;
+	long room = total_cost;
+	for (size_t k = 0; k < m; k++)
+	{
+		if (costs[order[k]] <= room)
+		{
+			room -= costs[order[k]];
+			greedy += times[order[k]];
+		}
+		lower = std::max(lower, times[order[k]]);
+	}
+	lower = std::max(lower, greedy);
+
+	// a stronger incumbent: keep the rides well before the critical ride, and
+	// solve the rides around it exactly with the dynamic algorithm
+	size_t critical = 0;
+	while (critical < m && prefix_costs[critical + 1] <= total_cost)
+	{
+		critical++;
+	}
+	size_t core_begin = critical > CORE_RADIUS ? critical - CORE_RADIUS : 0;
+	size_t core_end = std::min(m, critical + CORE_RADIUS);
+	size_t core_size = core_end - core_begin;
+	int* core_costs = workspace.borrow<int>(core_size);
+	double* core_times = workspace.borrow<double>(core_size);
+	size_t* core_selected = workspace.borrow<size_t>(core_size);
+	for (size_t k = 0; k < core_size; k++)
+	{
+		core_costs[k] = costs[order[core_begin + k]];
+		core_times[k] = times[order[core_begin + k]];
+	}
+	size_t core_count = dynamic_select(
+		core_costs, core_times, core_size, int(total_cost - prefix_costs[core_begin]), core_selected, workspace
+	);
+	double core = prefix_times[core_begin];
+	for (size_t k = 0; k < core_count; k++)
+	{
+		core += core_times[core_selected[k]];
+	}
+	lower = std::max(lower, core);
+
+	// bounds are sums of doubles; only trust a gap larger than rounding
+	double slack = 1e-9 * std::max(1.0, lower);
+
+	char* state = workspace.borrow_zeroed<char>(rides.size());
+	enum { DROPPED = 0, FREE = 1, FIXED = 2 };
+	for (size_t k = 0; k < m; k++)
+	{
+		size_t i = order[k];
+		double without = lp_bound_without(costs, times, order, prefix_costs, prefix_times, m, k, total_cost);
+		double with = times[i] + lp_bound_without(costs, times, order, prefix_costs, prefix_times, m, k, long(total_cost) - costs[i]);
+
+		if (without + slack < lower)
+		{
+			state[i] = FIXED;
+		}
+		else if (with + slack < lower)
+		{
+			state[i] = DROPPED;
+		}
+		else
+		{
+			state[i] = FREE;
+		}
+	}
+
+	for (size_t i = 0; i < rides.size(); i++)
+	{
+		if (state[i] == FIXED)
+		{
+			reduction.fixed.push_back(rides[i]);
+			reduction.free_budget -= costs[i];
+		}
+		else if (state[i] == FREE)
+		{
+			reduction.free.push_back(rides[i]);
+		}
+	}
+
+	return reduction;
+}
+
+
+// Merge the fixed rides of a reduction into the answer for its free rides.
+inline std::unique_ptr<RideVector> merge_reduction
+(
+	const RideReduction& reduction,
+	std::unique_ptr<RideVector> free_solution
+)
+{
+	for (auto& ride : reduction.fixed)
+	{
+		(*free_solution).push_back(ride);
+	}
+	return free_solution;
+}
+
+
+// Same answer value as dynamic_max_time, solving only the rides left undecided by reduce_rides.
+inline std::unique_ptr<RideVector> reduced_dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const RideOrderings* orderings = nullptr
+)
+{
+	RideReduction reduction = reduce_rides(rides, total_cost, orderings);
+	return merge_reduction(reduction, dynamic_max_time(reduction.free, reduction.free_budget));
+}
+
+
+// Same answer value as exhaustive_max_time, searching only the rides left undecided by reduce_rides.
+// The number of undecided rides, rather than of all rides, must be less than 64.
+inline std::unique_ptr<RideVector> reduced_exhaustive_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const RideOrderings* orderings = nullptr
+)
+{
+	RideReduction reduction = reduce_rides(rides, total_cost, orderings);
+	return merge_reduction(reduction, exhaustive_max_time(reduction.free, reduction.free_budget));
+}
+
+
+// Apply a guest's constraints: every ride in include is fixed into the answer,
+// and every ride in exclude is dropped. Rides are matched by identity, so both
+// vectors should hold pointers taken from rides.
+// Returns nullptr when the constraints cannot be met: a ride is both included and
+// excluded, or the included rides cost more than total_cost.
+inline std::unique_ptr<RideReduction> pin_rides
+(
+	const RideVector& rides,
+	int total_cost,
+	const RideVector& include,
+	const RideVector& exclude
+)
+{
+	std::unordered_set<const RideItem*> pinned, banned;
+	for (auto& ride : include)
+	{
+		pinned.insert(ride.get());
+	}
+	for (auto& ride : exclude)
+	{
+		banned.insert(ride.get());
+		if (pinned.count(ride.get()) != 0)
+		{
+			return nullptr;
+		}
+	}
+
+	std::unique_ptr<RideReduction> reduction(new RideReduction);
+	reduction->free_budget = total_cost;
+	for (auto& ride : rides)
+	{
+		if (pinned.count(ride.get()) != 0)
+		{
+			reduction->fixed.push_back(ride);
+			reduction->free_budget -= ride->cost();
+		}
+		else if (banned.count(ride.get()) == 0)
+		{
+			reduction->free.push_back(ride);
+		}
+	}
+
+	if (reduction->free_budget < 0)
+	{
+		return nullptr;
+	}
+	return reduction;
+}
+
+
+// Compute the optimal set of ride items with a dynamic algorithm, containing every ride
+// in include and none in exclude. The table only spans the free rides and the budget left
+// after the pinned ones. Returns nullptr when the constraints cannot be met.
+inline std::unique_ptr<RideVector> pinned_dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const RideVector& include,
+	const RideVector& exclude
+)
+{
+	std::unique_ptr<RideReduction> reduction = pin_rides(rides, total_cost, include, exclude);
+	if (!reduction)
+	{
+		return nullptr;
+	}
+	return merge_reduction(*reduction, dynamic_max_time(reduction->free, reduction->free_budget));
+}
+
+
+// Compute the optimal set of ride items with a exhaustive search algorithm, containing every ride
+// in include and none in exclude. Only the free rides are searched, so their number,
+// rather than the number of all rides, must be less than 64.
+// Returns nullptr when the constraints cannot be met.
+inline std::unique_ptr<RideVector> pinned_exhaustive_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const RideVector& include,
+	const RideVector& exclude
+)
+{
+	std::unique_ptr<RideReduction> reduction = pin_rides(rides, total_cost, include, exclude);
+	if (!reduction)
+	{
+		return nullptr;
+	}
+	return merge_reduction(*reduction, exhaustive_max_time(reduction->free, reduction->free_budget));
+}
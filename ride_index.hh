@@ -0,0 +1,298 @@
+///////////////////////////////////////////////////////////////////////////////
+// ride_index.hh
+//
+// Optional indexes of a ride vector, built on a background thread after the
+// rides are loaded.
+//
+// Building every index before answering the first query slows startup, and
+// building none slows every query. A BackgroundRideIndexes starts one thread
+// that builds, in order: the time order (for the longest-rides filter), the
+// ratio and cost orders (for the bounds, reduction and searches), cost
+// buckets, and a keyword index of the ride descriptions. Each index has a
+// readiness state that moves from INDEX_PENDING to INDEX_BUILDING to
+// INDEX_READY, published with release/acquire so a reader that sees
+// INDEX_READY sees the whole index. Every query method uses its index if it
+// is ready and otherwise answers with the same scan it would use without
+// indexes, so the first query never waits for the builder and later queries
+// speed up as indexes become ready.
+//
+// How to use:
+//
+//    auto rides = load_ride_database("ride.csv");
+//    BackgroundRideIndexes indexes(*rides);
+//    auto longest = indexes.filter_longest(100, 500, 100);
+//    auto best = reduced_dynamic_max_time(*rides, 500, indexes.orderings());
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+#include "maxtime.hh"
+#include "orderings.hh"
+
+
+// Readiness of one index.
+enum IndexState
+{
+	INDEX_PENDING,
+	INDEX_BUILDING,
+	INDEX_READY
+};
+
+
+// The optional indexes.
+enum RideIndexKind
+{
+	INDEX_TIME_ORDER,
+	INDEX_RATIO_COST_ORDER,
+	INDEX_COST_BUCKETS,
+	INDEX_KEYWORDS,
+	INDEX_KINDS
+};
+
+
+// Lowercase alphanumeric words of text, in order, with repeats.
+inline std::vector<std::string> description_words(const std::string& text)
+{
+	std::vector<std::string> words;
+	std::string word;
+	for (char c : text)
+	{
+		if (std::isalnum((unsigned char)c))
+		{
+			word += char(std::tolower((unsigned char)c));
+		}
+		else if (!word.empty())
+		{
+			words.push_back(word);
+			word.clear();
+		}
+	}
+	if (!word.empty())
+	{
+		words.push_back(word);
+	}
+	return words;
+}
+
+
+// Indexes of one ride vector built in the background; see the top of this file.
+// rides must outlive the object, whose destructor stops and joins the builder.
+class BackgroundRideIndexes
+{
+	//
+	public:
+
+		// Start building; start = false leaves every index pending until start() is called.
+		explicit BackgroundRideIndexes(const RideVector& rides, bool start = true)
+			:
+			_rides(rides),
+			_orderings(rides, 1),
+			_stop(false)
+		{
+			for (auto& state : _states)
+			{
+				state.store(INDEX_PENDING);
+			}
+			if (start)
+			{
+				this->start();
+			}
+		}
+
+		BackgroundRideIndexes(const BackgroundRideIndexes&) = delete;
+		BackgroundRideIndexes& operator=(const BackgroundRideIndexes&) = delete;
+
+		~BackgroundRideIndexes()
+		{
+			_stop.store(true);
+			wait();
+		}
+
+		// Start the builder thread, if not already started.
+		void start()
+		{
+			if (!_builder.joinable() && state(INDEX_TIME_ORDER) == INDEX_PENDING)
+			{
+				_builder = std::thread([this]() { build(); });
+			}
+		}
+
+		// Block until the builder has finished (or stopped).
+		void wait()
+		{
+			if (_builder.joinable())
+			{
+				_builder.join();
+			}
+		}
+
+		// Readiness of one index.
+		IndexState state(RideIndexKind kind) const
+		{
+			return IndexState(_states[kind].load(std::memory_order_acquire));
+		}
+
+		// Whether every index is ready.
+		bool ready() const
+		{
+			for (int kind = 0; kind < INDEX_KINDS; kind++)
+			{
+				if (state(RideIndexKind(kind)) != INDEX_READY)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// The ratio, cost and time orders of the rides, for the solvers that take a
+		// RideOrderings*, or nullptr while any of them is still being built.
+		const RideOrderings* orderings() const
+		{
+			bool built = state(INDEX_TIME_ORDER) == INDEX_READY && state(INDEX_RATIO_COST_ORDER) == INDEX_READY;
+			return built ? &_orderings : nullptr;
+		}
+
+		// filter_ride_vector(rides, min_time, max_time, total_size, FILTER_LONGEST), by the
+		// time order when ready and by the scan otherwise.
+		std::unique_ptr<RideVector> filter_longest(double min_time, double max_time, int total_size) const
+		{
+			if (state(INDEX_TIME_ORDER) == INDEX_READY)
+			{
+				return filter_ride_vector(_rides, min_time, max_time, total_size, _orderings);
+			}
+			return filter_ride_vector(_rides, min_time, max_time, total_size, FILTER_LONGEST);
+		}
+
+		// Indices of the rides costing at most max_cost, in increasing order.
+		std::vector<size_t> rides_costing_at_most(int max_cost) const
+		{
+			std::vector<size_t> found;
+			if (state(INDEX_COST_BUCKETS) == INDEX_READY)
+			{
+				// buckets hold each cost's rides in index order; merge the cheap ones
+				auto end = std::upper_bound(_bucket_costs.begin(), _bucket_costs.end(), max_cost);
+				found.assign(_bucketed.begin(), _bucketed.begin() + _bucket_starts[end - _bucket_costs.begin()]);
+				std::sort(found.begin(), found.end());
+				return found;
+			}
+			for (size_t i = 0; i < _rides.size(); i++)
+			{
+				if (_rides[i]->cost() <= max_cost)
+				{
+					found.push_back(i);
+				}
+			}
+			return found;
+		}
+
+		// Indices of the rides whose description contains keyword as a whole word, ignoring
+		// case, in increasing order. keyword is one word as split by description_words.
+		std::vector<size_t> rides_with_keyword(const std::string& keyword) const
+		{
+			std::vector<std::string> words = description_words(keyword);
+			if (words.size() != 1)
+			{
+				return std::vector<size_t>();
+			}
+			if (state(INDEX_KEYWORDS) == INDEX_READY)
+			{
+				auto found = _keywords.find(words[0]);
+				return found == _keywords.end() ? std::vector<size_t>() : found->second;
+			}
+			std::vector<size_t> found;
+			for (size_t i = 0; i < _rides.size(); i++)
+			{
+				std::vector<std::string> described = description_words(_rides[i]->description());
+				if (std::find(described.begin(), described.end(), words[0]) != described.end())
+				{
+					found.push_back(i);
+				}
+			}
+			return found;
+		}
+
+	//
+	private:
+
+		// Builder thread: each index in turn, unless asked to stop.
+		void build()
+		{
+			auto building = [&](RideIndexKind kind)
+			{
+				if (_stop.load())
+				{
+					return false;
+				}
+				_states[kind].store(INDEX_BUILDING, std::memory_order_relaxed);
+				return true;
+			};
+			auto ready = [&](RideIndexKind kind) { _states[kind].store(INDEX_READY, std::memory_order_release); };
+
+			if (!building(INDEX_TIME_ORDER)) return;
+			_orderings.by_time();
+			ready(INDEX_TIME_ORDER);
+
+			if (!building(INDEX_RATIO_COST_ORDER)) return;
+			_orderings.by_ratio();
+			_orderings.by_cost();
+			ready(INDEX_RATIO_COST_ORDER);
+
+			// the cost order is already built; cut it where the cost changes
+			if (!building(INDEX_COST_BUCKETS)) return;
+			for (size_t i : _orderings.by_cost())
+			{
+				int cost = _rides[i]->cost();
+				if (_bucket_costs.empty() || _bucket_costs.back() != cost)
+				{
+					_bucket_costs.push_back(cost);
+					_bucket_starts.push_back(_bucketed.size());
+				}
+				_bucketed.push_back(i);
+			}
+			_bucket_starts.push_back(_bucketed.size());
+			ready(INDEX_COST_BUCKETS);
+
+			if (!building(INDEX_KEYWORDS)) return;
+			for (size_t i = 0; i < _rides.size(); i++)
+			{
+				for (const std::string& word : description_words(_rides[i]->description()))
+				{
+					std::vector<size_t>& rides = _keywords[word];
+					if (rides.empty() || rides.back() != i)
+					{
+						rides.push_back(i);
+					}
+				}
+			}
+			ready(INDEX_KEYWORDS);
+		}
+
+		const RideVector& _rides;
+		RideOrderings _orderings;
+
+		// distinct costs in increasing order; bucket k is _bucketed[_bucket_starts[k] .. _bucket_starts[k + 1])
+		std::vector<int> _bucket_costs;
+		std::vector<size_t> _bucket_starts;
+		std::vector<size_t> _bucketed;
+
+		// word -> indices of the rides using it, increasing
+		std::map<std::string, std::vector<size_t>> _keywords;
+
+		std::atomic<int> _states[INDEX_KINDS];
+		std::atomic<bool> _stop;
+		std::thread _builder;
+};
@@ -0,0 +1,230 @@
+///////////////////////////////////////////////////////////////////////////////
+// roofline.hh
+//
+// Roofline placement of the solver kernels, for maxtime_bench --roofline.
+//
+// The host's roofs are measured with small probes: a STREAM triad over arrays
+// far larger than the caches (DRAM bandwidth) and over arrays that fit in L2
+// but not L1 (cache bandwidth), and independent operation chains in double
+// and in 64-bit integer arithmetic (compute peaks). Each kernel sample records the
+// bytes its operands move and the operations it performs, counted from the
+// kernel's code rather than by hardware counters, and its working set. A
+// sample is placed under the cache roof if its working set fits in
+// ROOFLINE_CACHE_BYTES and under the DRAM roof otherwise; it is memory-bound if its
+// arithmetic intensity is left of that roof's ridge point.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+#include "isa.hh"
+#include "timer.hh"
+
+
+// Working sets up to this many bytes are assumed to stay in cache.
+const double ROOFLINE_CACHE_BYTES = 1 << 20;
+
+
+// Measured roofs of the host.
+struct RooflinePeaks
+{
+	// Bytes per second, from the triad over DRAM-sized and L2-sized arrays.
+	double dram_bandwidth;
+	double cache_bandwidth;
+
+	// Operations per second.
+	double flops;
+	double int_ops;
+};
+
+
+// One timed run of a kernel, with its operation and traffic counts.
+struct KernelSample
+{
+	std::string kernel;
+	std::string parameters;
+
+	// Whether ops are double-precision (true) or integer operations.
+	bool floating_point;
+
+	double seconds;
+	double bytes;
+	double ops;
+	double working_set;
+};
+
+
+// A sample placed on the roofline.
+struct RooflinePoint
+{
+	KernelSample sample;
+
+	// ops per byte.
+	double intensity;
+
+	// Achieved operations and bytes per second.
+	double achieved_ops;
+	double achieved_bandwidth;
+
+	// "cache" or "dram".
+	std::string roof;
+
+	// Best rate the roofline allows at this intensity, and whether memory sets it.
+	double attainable_ops;
+	bool memory_bound;
+};
+
+
+// a[i] = b[i] + scalar * c[i]
+MAXTIME_KERNEL
+inline void stream_triad(double* a, const double* b, const double* c, double scalar, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		a[i] = b[i] + scalar * c[i];
+	}
+}
+
+// Bytes per second of the triad over arrays of n doubles, best of repeats.
+// Counts 24 bytes per element, ignoring the write-allocate read of a.
+inline double measure_triad_bandwidth(size_t n, size_t repeats)
+{
+	std::vector<double> a(n, 0), b(n, 1), c(n, 2);
+	double best = 0;
+	for (size_t r = 0; r < repeats; r++)
+	{
+		Timer timer;
+		stream_triad(a.data(), b.data(), c.data(), 3.0, n);
+		best = std::max(best, 24.0 * n / timer.elapsed());
+	}
+	// keep the stores live
+	return a[n / 2] == 7.0 ? best : best * (1 + a[n / 2]);
+}
+
+// 32 independent chains of x = x * m + k in double, or x = (x + m) ^ k in 64-bit integers
+// (which have no vector multiply below AVX-512DQ), for `steps` steps; 2 operations each.
+// Returns a value depending on every chain so the work is not optimized away.
+template <typename T>
+MAXTIME_KERNEL
+T operation_chains(T m, T k, size_t steps)
+{
+	T x[32];
+	for (size_t lane = 0; lane < 32; lane++)
+	{
+		x[lane] = T(lane);
+	}
+	for (size_t s = 0; s < steps; s++)
+	{
+		for (size_t lane = 0; lane < 32; lane++)
+		{
+			if constexpr (std::is_floating_point<T>::value)
+			{
+				x[lane] = x[lane] * m + k;
+			}
+			else
+			{
+				x[lane] = (x[lane] + m) ^ k;
+			}
+		}
+	}
+	T sum = 0;
+	for (size_t lane = 0; lane < 32; lane++)
+	{
+		sum += x[lane];
+	}
+	return sum;
+}
+
+// Operations per second of operation_chains<T>, best of three.
+template <typename T>
+double measure_operation_rate(size_t steps)
+{
+	double best = 0;
+	volatile T sink = 0;
+	for (int r = 0; r < 3; r++)
+	{
+		Timer timer;
+		sink = sink + operation_chains<T>(T(1), T(3), steps);
+		best = std::max(best, 64.0 * steps / timer.elapsed());
+	}
+	return best;
+}
+
+// Measure the roofs of this host; takes about a second.
+inline RooflinePeaks measure_roofline_peaks()
+{
+	RooflinePeaks peaks;
+	peaks.dram_bandwidth = measure_triad_bandwidth(size_t(1) << 23, 5);
+	peaks.cache_bandwidth = measure_triad_bandwidth(4096, 5000);
+	peaks.flops = measure_operation_rate<double>(size_t(1) << 23);
+	peaks.int_ops = measure_operation_rate<uint64_t>(size_t(1) << 23);
+	return peaks;
+}
+
+
+// Place a sample under the roof its working set calls for.
+inline RooflinePoint place_on_roofline(const KernelSample& sample, const RooflinePeaks& peaks)
+{
+	RooflinePoint point;
+	point.sample = sample;
+	point.intensity = sample.ops / sample.bytes;
+	point.achieved_ops = sample.ops / sample.seconds;
+	point.achieved_bandwidth = sample.bytes / sample.seconds;
+
+	bool in_cache = sample.working_set <= ROOFLINE_CACHE_BYTES;
+	point.roof = in_cache ? "cache" : "dram";
+	double bandwidth = in_cache ? peaks.cache_bandwidth : peaks.dram_bandwidth;
+	double compute = sample.floating_point ? peaks.flops : peaks.int_ops;
+
+	point.attainable_ops = std::min(compute, point.intensity * bandwidth);
+	point.memory_bound = point.intensity * bandwidth < compute;
+	return point;
+}
+
+
+// One CSV row per point, after a header row.
+inline void write_roofline_csv(std::ostream& out, const RooflinePeaks& peaks, const std::vector<RooflinePoint>& points)
+{
+	out << "# dram_bandwidth=" << peaks.dram_bandwidth << " cache_bandwidth=" << peaks.cache_bandwidth
+		<< " flops=" << peaks.flops << " int_ops=" << peaks.int_ops << '\n';
+	out << "kernel,parameters,ops_kind,seconds,bytes,ops,working_set,intensity,achieved_ops,achieved_bandwidth,roof,attainable_ops,bound\n";
+	for (const RooflinePoint& point : points)
+	{
+		const KernelSample& sample = point.sample;
+		out << sample.kernel << ',' << sample.parameters << ',' << (sample.floating_point ? "flop" : "int") << ','
+			<< sample.seconds << ',' << sample.bytes << ',' << sample.ops << ',' << sample.working_set << ','
+			<< point.intensity << ',' << point.achieved_ops << ',' << point.achieved_bandwidth << ','
+			<< point.roof << ',' << point.attainable_ops << ',' << (point.memory_bound ? "memory" : "compute") << '\n';
+	}
+}
+
+// The same as one JSON object: {"peaks": {...}, "kernels": [{...}, ...]}.
+inline void write_roofline_json(std::ostream& out, const RooflinePeaks& peaks, const std::vector<RooflinePoint>& points)
+{
+	out << "{\"peaks\": {\"dram_bandwidth\": " << peaks.dram_bandwidth << ", \"cache_bandwidth\": " << peaks.cache_bandwidth
+		<< ", \"flops\": " << peaks.flops << ", \"int_ops\": " << peaks.int_ops << "},\n \"kernels\": [";
+	for (size_t k = 0; k < points.size(); k++)
+	{
+		const RooflinePoint& point = points[k];
+		const KernelSample& sample = point.sample;
+		out << (k == 0 ? "\n  " : ",\n  ")
+			<< "{\"kernel\": \"" << sample.kernel << "\", \"parameters\": \"" << sample.parameters
+			<< "\", \"ops_kind\": \"" << (sample.floating_point ? "flop" : "int")
+			<< "\", \"seconds\": " << sample.seconds << ", \"bytes\": " << sample.bytes << ", \"ops\": " << sample.ops
+			<< ", \"working_set\": " << sample.working_set << ", \"intensity\": " << point.intensity
+			<< ", \"achieved_ops\": " << point.achieved_ops << ", \"achieved_bandwidth\": " << point.achieved_bandwidth
+			<< ", \"roof\": \"" << point.roof << "\", \"attainable_ops\": " << point.attainable_ops
+			<< ", \"bound\": \"" << (point.memory_bound ? "memory" : "compute") << "\"}";
+	}
+	out << "\n]}\n";
+}
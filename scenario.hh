@@ -0,0 +1,301 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenario.hh
+//
+// Solve a batch of what-if scenarios over one ride catalog, where each
+// scenario changes the price or time of a few rides, or removes them.
+//
+// The rides no scenario touches are put first, and their dynamic programming
+// rows are computed once for the largest budget in the batch. The changed
+// rides follow, as a tree: at each level the scenarios are grouped by their
+// version of the next changed ride, and each group extends its parent's row
+// with one more row. A scenario therefore only pays for the rows of its
+// changed rides that it does not share with another scenario.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+
+#include "maxtime.hh"
+#include "workspace.hh"
+
+
+// One change a scenario makes to a ride of the catalog.
+struct RideOverride
+{
+	// Index of the changed ride in the catalog.
+	size_t index;
+
+	// Whether the ride is unavailable in this scenario; cost and time are ignored if so.
+	bool removed;
+
+	// New cost, in dollars; must be positive.
+	int cost;
+
+	// New time, in minutes.
+	double time;
+};
+
+
+// One what-if question: the best rides within total_cost after applying overrides.
+struct RideScenario
+{
+	int total_cost;
+	std::vector<RideOverride> overrides;
+};
+
+
+// Solves a batch of scenarios; see scenario_max_time below.
+class ScenarioSolver
+{
+	//
+	public:
+
+		//
+		ScenarioSolver
+		(
+			const RideVector& rides,
+			const std::vector<RideScenario>& scenarios,
+			SolverWorkspace& workspace
+		)
+			:
+			_rides(rides),
+			_scenarios(scenarios),
+			_workspace(workspace),
+			_total_cost(0),
+			_results(scenarios.size())
+		{
+			// each scenario's version of each ride it changes; later overrides win
+			_versions.resize(scenarios.size());
+			std::map<size_t, std::vector<Version>> variants;
+			for (size_t s = 0; s < scenarios.size(); s++)
+			{
+				_total_cost = std::max(_total_cost, scenarios[s].total_cost);
+				for (const RideOverride& change : scenarios[s].overrides)
+				{
+					assert(change.index < rides.size());
+					assert(change.removed || change.cost > 0);
+					_versions[s][change.index] = Version{ change.removed, change.cost, change.time };
+				}
+			}
+			for (size_t s = 0; s < scenarios.size(); s++)
+			{
+				for (auto& entry : _versions[s])
+				{
+					variants[entry.first].push_back(entry.second);
+				}
+			}
+
+			// changed rides with the fewest distinct versions go first, so scenarios
+			// share the longest possible path down the tree
+			std::vector<std::pair<size_t, size_t>> order;
+			for (auto& entry : variants)
+			{
+				std::vector<Version>& versions = entry.second;
+				versions.push_back(base_version(entry.first));
+				std::sort(versions.begin(), versions.end());
+				size_t distinct = std::unique(versions.begin(), versions.end()) - versions.begin();
+				order.push_back(std::make_pair(distinct, entry.first));
+			}
+			std::sort(order.begin(), order.end());
+			for (auto& entry : order)
+			{
+				_changed.push_back(entry.second);
+			}
+
+			for (size_t i = 0; i < rides.size(); i++)
+			{
+				if (variants.count(i) == 0)
+				{
+					_unchanged.push_back(i);
+				}
+			}
+		}
+
+		// Solve every scenario; result k answers scenario k.
+		std::vector<std::unique_ptr<RideVector>> solve()
+		{
+			if (_total_cost < 0 || _scenarios.empty())
+			{
+				for (auto& result : _results)
+				{
+					result.reset(new RideVector);
+				}
+				return std::move(_results);
+			}
+
+			SolverWorkspace::Frame frame(_workspace);
+
+			_width = size_t(_total_cost) + 1;
+			_words = (_width + 63) / 64;
+
+			// shared prefix: the rows of the unchanged rides, computed once
+			double* previous = _workspace.borrow_zeroed<double>(_width);
+			double* next = _workspace.borrow<double>(_width);
+			_prefix_taken = _workspace.borrow_zeroed<uint64_t>(_unchanged.size() * _words);
+			for (size_t k = 0; k < _unchanged.size(); k++)
+			{
+				const RideItem& ride = *_rides[_unchanged[k]];
+				dynamic_row_update(previous, next, _prefix_taken + k * _words, _total_cost, ride.cost(), ride.time());
+				std::swap(previous, next);
+			}
+
+			_path.resize(_changed.size());
+			std::vector<size_t> everyone(_scenarios.size());
+			for (size_t s = 0; s < _scenarios.size(); s++)
+			{
+				everyone[s] = s;
+			}
+			branch(0, previous, everyone);
+
+			return std::move(_results);
+		}
+
+	//
+	private:
+
+		// A version of a changed ride.
+		struct Version
+		{
+			bool removed;
+			int cost;
+			double time;
+
+			bool operator<(const Version& other) const
+			{
+				return std::tie(removed, cost, time) < std::tie(other.removed, other.cost, other.time);
+			}
+			bool operator==(const Version& other) const
+			{
+				return removed == other.removed && cost == other.cost && time == other.time;
+			}
+		};
+
+		// The version of ride i on the path to the current tree node, and its decision bits.
+		struct Step
+		{
+			Version version;
+			const uint64_t* taken;
+		};
+
+		Version base_version(size_t i) const
+		{
+			return Version{ false, _rides[i]->cost(), _rides[i]->time() };
+		}
+
+		Version version_of(size_t scenario, size_t i) const
+		{
+			auto found = _versions[scenario].find(i);
+			return found == _versions[scenario].end() ? base_version(i) : found->second;
+		}
+
+		// Extend row with the changed ride at depth, once per distinct version among scenarios.
+		void branch(size_t depth, const double* row, const std::vector<size_t>& scenarios)
+		{
+			if (depth == _changed.size())
+			{
+				for (size_t s : scenarios)
+				{
+					traceback(s);
+				}
+				return;
+			}
+
+			std::map<Version, std::vector<size_t>> groups;
+			size_t i = _changed[depth];
+			for (size_t s : scenarios)
+			{
+				groups[version_of(s, i)].push_back(s);
+			}
+
+			for (auto& group : groups)
+			{
+				const Version& version = group.first;
+				if (version.removed)
+				{
+					_path[depth] = Step{ version, nullptr };
+					branch(depth + 1, row, group.second);
+					continue;
+				}
+
+				SolverWorkspace::Frame frame(_workspace);
+				double* next = _workspace.borrow<double>(_width);
+				uint64_t* taken = _workspace.borrow_zeroed<uint64_t>(_words);
+				dynamic_row_update(row, next, taken, _total_cost, version.cost, version.time);
+				_path[depth] = Step{ version, taken };
+				branch(depth + 1, next, group.second);
+			}
+		}
+
+		// Trace the decision bits of scenario s back from its budget: first the changed rides
+		// on the current path, then the shared prefix.
+		void traceback(size_t s)
+		{
+			std::unique_ptr<RideVector> best(new RideVector);
+			int cost = _scenarios[s].total_cost;
+			if (cost < 0)
+			{
+				_results[s] = std::move(best);
+				return;
+			}
+
+			for (size_t depth = _changed.size(); depth > 0; depth--)
+			{
+				const Step& step = _path[depth - 1];
+				if (step.taken != nullptr && ((step.taken[cost / 64] >> (cost % 64)) & 1))
+				{
+					std::shared_ptr<RideItem> ride = _rides[_changed[depth - 1]];
+					if (ride->cost() != step.version.cost || ride->time() != step.version.time)
+					{
+						ride = std::make_shared<RideItem>(ride->description(), step.version.cost, step.version.time);
+					}
+					(*best).push_back(ride);
+					cost -= step.version.cost;
+				}
+			}
+
+			for (size_t k = _unchanged.size(); k > 0; k--)
+			{
+				if ((_prefix_taken[(k - 1) * _words + cost / 64] >> (cost % 64)) & 1)
+				{
+					(*best).push_back(_rides[_unchanged[k - 1]]);
+					cost -= _rides[_unchanged[k - 1]]->cost();
+				}
+			}
+
+			_results[s] = std::move(best);
+		}
+
+		const RideVector& _rides;
+		const std::vector<RideScenario>& _scenarios;
+		SolverWorkspace& _workspace;
+		int _total_cost;
+		size_t _width, _words;
+		std::vector<std::map<size_t, Version>> _versions;
+		std::vector<size_t> _changed, _unchanged;
+		uint64_t* _prefix_taken;
+		std::vector<Step> _path;
+		std::vector<std::unique_ptr<RideVector>> _results;
+};
+
+
+// Compute the optimal set of ride items for each scenario, as dynamic_max_time would on
+// the catalog with that scenario's overrides applied. Rides a scenario changes appear in
+// its answer as new RideItem objects carrying the changed cost and time.
+inline std::vector<std::unique_ptr<RideVector>> scenario_max_time
+(
+	const RideVector& rides,
+	const std::vector<RideScenario>& scenarios
+)
+{
+	ScenarioSolver solver(rides, scenarios, thread_workspace());
+	return solver.solve();
+}
@@ -4,9 +4,9 @@
 // Timer class for code timing.
 //
 // This class depends only on the C++11 STL so it ought to be
-// portable. It uses the std::clock() function which is precise to
-// platform-dependent fractions of a second, as specified by
-// CLOCKS_PER_SEC.
+// portable. It measures wall time with std::chrono::high_resolution_clock.
+// CPU time per thread and the reports of parallel phases, which need
+// POSIX, are in parallel_report.hh.
 //
 // How to use:
 //
@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////////////
+// workspace.hh
+//
+// Reusable scratch memory for the ride solvers.
+//
+// A SolverWorkspace is a monotonic arena: solvers borrow rows, decision bits
+// and candidate buffers from it, and everything borrowed inside a Frame is
+// released at once when the Frame ends. When a query needs more memory than
+// the arena holds, the extra is taken from spill blocks; once the outermost
+// Frame closes, the spill is folded into a single block of the high-water
+// size. After the first few queries of a given size, a solver using the
+// same workspace performs no heap allocation for its scratch space.
+//
+// How to use:
+//
+//    SolverWorkspace& workspace = thread_workspace();
+//    SolverWorkspace::Frame frame(workspace);
+//    double* row = workspace.borrow<double>(total_cost + 1);
+//    // row is valid until frame goes out of scope
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+
+// Monotonic scratch arena shared by the solvers.
+// A workspace is not thread safe; use one per thread (see thread_workspace()).
+class SolverWorkspace
+{
+	//
+	public:
+
+		// Borrowed buffers are aligned to a cache line so that rows can be
+		// loaded with aligned vector instructions.
+		static const size_t ALIGNMENT = 64;
+
+		// Marks the current arena position and releases everything borrowed
+		// after it when destroyed. Frames nest.
+		class Frame
+		{
+			public:
+
+				explicit Frame(SolverWorkspace& workspace)
+					:
+					_workspace(workspace),
+					_mark(workspace._used)
+				{
+					_workspace._depth++;
+				}
+
+				~Frame()
+				{
+					_workspace.release(_mark);
+				}
+
+				Frame(const Frame&) = delete;
+				Frame& operator=(const Frame&) = delete;
+
+			private:
+
+				SolverWorkspace& _workspace;
+				size_t _mark;
+		};
+
+		//
+		SolverWorkspace()
+			:
+			_capacity(0),
+			_used(0),
+			_spilled(0),
+			_high_water(0),
+			_depth(0),
+			_allocations(0)
+		{
+		}
+
+		SolverWorkspace(const SolverWorkspace&) = delete;
+		SolverWorkspace& operator=(const SolverWorkspace&) = delete;
+
+		// Borrow uninitialized storage for count objects of type T.
+		// Must be called inside a Frame; the storage is valid until that Frame ends.
+		template <typename T>
+		T* borrow(size_t count)
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "workspace buffers are never destroyed");
+			assert(_depth > 0);
+
+			size_t bytes = round_up(count * sizeof(T));
+
+			if (_used + bytes <= _capacity)
+			{
+				T* result = reinterpret_cast<T*>(_buffer.get() + _used);
+				_used += bytes;
+				note_usage();
+				return result;
+			}
+
+			// Does not fit; take a spill block that lives until the outermost Frame ends.
+			_spill.push_back(allocate(bytes));
+			_spilled += bytes;
+			note_usage();
+			return reinterpret_cast<T*>(_spill.back().get());
+		}
+
+		// Borrow storage for count objects of type T, set to all-zero bytes.
+		template <typename T>
+		T* borrow_zeroed(size_t count)
+		{
+			T* result = borrow<T>(count);
+			std::memset(static_cast<void*>(result), 0, count * sizeof(T));
+			return result;
+		}
+
+		// Grow the arena ahead of time so the first query does not spill.
+		void reserve(size_t bytes)
+		{
+			assert(_depth == 0);
+			bytes = round_up(bytes);
+			if (bytes > _capacity)
+			{
+				_buffer = allocate(bytes);
+				_capacity = bytes;
+			}
+		}
+
+		// Bytes currently held by the main block.
+		size_t capacity() const { return _capacity; }
+
+		// Largest number of bytes borrowed at once so far.
+		size_t high_water() const { return _high_water; }
+
+		// Number of heap allocations made by this workspace; constant in steady state.
+		size_t allocations() const { return _allocations; }
+
+	//
+	private:
+
+		typedef std::unique_ptr<unsigned char[], void (*)(unsigned char*)> Block;
+
+		static size_t round_up(size_t bytes)
+		{
+			return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		}
+
+		static void free_block(unsigned char* block)
+		{
+			::operator delete[](block, std::align_val_t(ALIGNMENT));
+		}
+
+		Block allocate(size_t bytes)
+		{
+			_allocations++;
+			unsigned char* block = static_cast<unsigned char*>(
+				::operator new[](bytes == 0 ? ALIGNMENT : bytes, std::align_val_t(ALIGNMENT))
+			);
+			return Block(block, free_block);
+		}
+
+		void note_usage()
+		{
+			if (_used + _spilled > _high_water)
+			{
+				_high_water = _used + _spilled;
+			}
+		}
+
+		void release(size_t mark)
+		{
+			assert(_depth > 0);
+			_used = mark;
+			_depth--;
+
+			// Outermost frame closed: fold any spill into one block of high-water size.
+			if (_depth == 0 && !_spill.empty())
+			{
+				_spill.clear();
+				_spilled = 0;
+				_buffer = allocate(_high_water);
+				_capacity = _high_water;
+			}
+		}
+
+		Block _buffer{nullptr, free_block};
+		std::vector<Block> _spill;
+		size_t _capacity, _used, _spilled, _high_water;
+		int _depth;
+		size_t _allocations;
+};
+
+
+// The calling thread's workspace, used by solvers when the caller does not supply one.
+inline SolverWorkspace& thread_workspace()
+{
+	thread_local SolverWorkspace workspace;
+	return workspace;
+}